@@ -1,13 +1,21 @@
 #include "SampleFilter.h"
 
-static double filter_taps[SAMPLEFILTER_TAP_NUM] = {
-  0.03946073714347548,
-  0.11838248117085194,
-  0.2071692727265806,
-  0.24663000987005582,
-  0.2071692727265806,
-  0.11838248117085194,
-  0.03946073714347548
+// Filter taps, in Q15:
+//   0.03946073714347548,
+//   0.11838248117085194,
+//   0.2071692727265806,
+//   0.24663000987005582,
+//   0.2071692727265806,
+//   0.11838248117085194,
+//   0.03946073714347548
+const int16_t SampleFilter_defaultTaps[SAMPLEFILTER_TAP_NUM] = {
+  1293,
+  3879,
+  6789,
+  8082,
+  6789,
+  3879,
+  1293
 };
 
 void SampleFilter_init(SampleFilter* f) {
@@ -15,21 +23,28 @@ void SampleFilter_init(SampleFilter* f) {
   for(i = 0; i < SAMPLEFILTER_TAP_NUM; ++i)
     f->history[i] = 0;
   f->last_index = 0;
+  SampleFilter_setTaps(f, SampleFilter_defaultTaps);
 }
 
-void SampleFilter_put(SampleFilter* f, double input) {
+void SampleFilter_setTaps(SampleFilter* f, const int16_t* taps) {
+  int i;
+  for(i = 0; i < SAMPLEFILTER_TAP_NUM; ++i)
+    f->taps[i] = taps[i];
+}
+
+void SampleFilter_put(SampleFilter* f, int32_t input) {
   f->history[f->last_index++] = input;
   if(f->last_index == SAMPLEFILTER_TAP_NUM)
     f->last_index = 0;
 }
 
-double SampleFilter_get(SampleFilter* f) {
-  double acc = 0;
+int32_t SampleFilter_get(SampleFilter* f) {
+  int64_t acc = 0;
   int index = f->last_index, i;
   for(i = 0; i < SAMPLEFILTER_TAP_NUM; ++i) {
     index = index != 0 ? index-1 : SAMPLEFILTER_TAP_NUM-1;
-    acc += f->history[index] * filter_taps[i];
+    acc += (int64_t)f->history[index] * f->taps[i];
   };
-  return acc;
+  return acc >> SAMPLEFILTER_TAP_BITS;
 }
 
@@ -20,16 +20,26 @@ sampling frequency: 800 Hz
 
 */
 
+#include <stdint.h>
+
 #define SAMPLEFILTER_TAP_NUM 7
+#define SAMPLEFILTER_TAP_BITS 15    // Taps are stored in Q15 fixed point
+
+// Taps of the filter above, which SampleFilter_init() starts with
+extern const int16_t SampleFilter_defaultTaps[SAMPLEFILTER_TAP_NUM];
 
+// The filter works on fixed point samples, in any format. The output is in
+// the same format as the input.
 typedef struct {
-  double history[SAMPLEFILTER_TAP_NUM];
+  int32_t history[SAMPLEFILTER_TAP_NUM];
   unsigned int last_index;
+  int16_t taps[SAMPLEFILTER_TAP_NUM];
 } SampleFilter;
 
 void SampleFilter_init(SampleFilter* f);
-void SampleFilter_put(SampleFilter* f, double input);
-double SampleFilter_get(SampleFilter* f);
+void SampleFilter_setTaps(SampleFilter* f, const int16_t* taps);
+void SampleFilter_put(SampleFilter* f, int32_t input);
+int32_t SampleFilter_get(SampleFilter* f);
 
 #endif
 
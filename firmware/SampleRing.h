@@ -0,0 +1,77 @@
+#ifndef SAMPLERING_H_
+#define SAMPLERING_H_
+
+#include <stdint.h>
+
+#define SAMPLERING_SIZE 16      // Samples the ring can hold (power of 2); 20ms at 800Hz
+
+// Accelerometer sample, with the time it was taken
+struct AccelerometerSample {
+    uint16_t time;              // FTM1 count when the data ready interrupt came in
+    int32_t X, Y, Z;            // Acceleration on each axis, in m/s^2 (Q16.16)
+};
+
+// Hands samples from the accelerometer interrupt to the main loop, without
+// locking. There must be only one writer (the interrupt) and one reader.
+// Each side only writes its own index, and the data is in place before the
+// index that publishes it is updated.
+class SampleRing {
+private:
+    AccelerometerSample samples[SAMPLERING_SIZE];
+    volatile uint8_t head;      // Next slot to write (only changed by put())
+    volatile uint8_t tail;      // Next slot to read (only changed by get())
+
+public:
+    volatile uint32_t overruns; // Samples dropped because the ring was full
+    uint8_t maxPending;         // Most samples that get() has found waiting
+
+    // Empty the ring, and the counts. This writes both indexes, so only call
+    // it while the interrupt can't run.
+    void clear() {
+        head = 0;
+        tail = 0;
+        overruns = 0;
+        maxPending = 0;
+    }
+
+    // Throw away the samples that are waiting (from the main loop). Only the
+    // reader's index moves, so the interrupt can carry on.
+    void discard() {
+        tail = head;
+    }
+
+    // Add a sample (from the interrupt)
+    // @return false if the ring was full, and the sample was dropped
+    bool put(const AccelerometerSample& sample) {
+        uint8_t next = (head + 1) & (SAMPLERING_SIZE - 1);
+        if(next == tail) {
+            overruns++;
+            return false;
+        }
+
+        samples[head] = sample;
+        asm volatile("" : : : "memory");    // Write the sample before publishing it
+        head = next;
+        return true;
+    }
+
+    // Take the oldest sample (from the main loop)
+    // @return false if there weren't any
+    bool get(AccelerometerSample& sample) {
+        uint8_t pending = (head - tail) & (SAMPLERING_SIZE - 1);
+        if(pending == 0) {
+            return false;
+        }
+        if(pending > maxPending) {
+            maxPending = pending;
+        }
+
+        asm volatile("" : : : "memory");    // Read the index before the sample
+        sample = samples[tail];
+        asm volatile("" : : : "memory");    // Read the sample before freeing the slot
+        tail = (tail + 1) & (SAMPLERING_SIZE - 1);
+        return true;
+    }
+};
+
+#endif
@@ -1,3 +1,4 @@
+#include <string.h>
 #include "animation.h"
 
 Animation::Animation() {
@@ -26,43 +27,374 @@ void Animation::init(const uint16_t frameCount_,
   ledCount = ledCount_;
   frameDelay = frameDelay_;
 
+  firstFrame = frameData;
+  keyframeInterval = 0;
+  keyframeOffsets = NULL;
+
+  switch(encoding) {
+    case ENCODING_INDEXED_4:
+    case ENCODING_INDEXED_8:
+      // Frames start after the palette
+      firstFrame = frameData + 1 + (frameData[0] + 1)*3;
+      break;
+
+    case ENCODING_RGB565_RLE:
+    case ENCODING_XOR_DELTA:
+      // An interval of 0 means there's no index, just frame 0
+      keyframeInterval = frameData[0];
+      keyframeOffsets = frameData + 1;
+      if(keyframeInterval != 0) {
+        firstFrame = keyframeOffsets + (frameCount + keyframeInterval - 1)/keyframeInterval*2;
+      }
+      else {
+        firstFrame = keyframeOffsets;
+      }
+      break;
+  }
+
   reset();
 }
- 
+
+bool Animation::check(uint32_t length) {
+  const uint8_t* end = frameData + length;
+
+  if(frameCount == 0 || ledCount == 0) {
+    return false;
+  }
+
+  switch(encoding) {
+    case ENCODING_RGB24:
+      return (uint32_t)frameCount*ledCount*3 <= length;
+
+    case ENCODING_RGB565:
+      return (uint32_t)frameCount*ledCount*2 <= length;
+
+    case ENCODING_INDEXED_4:
+    case ENCODING_INDEXED_8:
+      return checkIndexes(end);
+
+    case ENCODING_RGB565_RLE:
+    case ENCODING_XOR_DELTA:
+      break;
+
+    default:
+      return false;
+  }
+
+  // Walk through every frame, checking that the keyframes are where the
+  // index says
+  if(length == 0 || firstFrame > end) {
+    return false;
+  }
+
+  const uint8_t* data = firstFrame;
+  for(int frame = 0; frame < frameCount; frame++) {
+    if(keyframeInterval != 0 && frame%keyframeInterval == 0) {
+      const uint8_t* offset = keyframeOffsets + frame/keyframeInterval*2;
+      if(data != firstFrame + (offset[0] | (offset[1] << 8))) {
+        return false;
+      }
+    }
+
+    if(encoding == ENCODING_RGB565_RLE) {
+      // Runs have to be at least 1 long, and can't cross frames
+      for(int led = 0; led < ledCount; data += 3) {
+        if(data + 3 > end || data[0] == 0) {
+          return false;
+        }
+        led += data[0];
+        if(led > ledCount) {
+          return false;
+        }
+      }
+    }
+    else {
+      if(data + (ledCount + 7)/8 > end) {
+        return false;
+      }
+      data += frameLength(data);
+    }
+  }
+
+  return data <= end;
+}
+
+bool Animation::checkIndexes(const uint8_t* end) {
+  // The palette has to be there, and the frames after it
+  uint32_t colors = frameData[0] + 1;
+  if(firstFrame > end) {
+    return false;
+  }
+
+  bool packed = (encoding == ENCODING_INDEXED_4);
+  uint32_t bytesPerFrame = packed ? (ledCount + 1)/2 : ledCount;
+  if((uint32_t)(end - firstFrame) < (uint32_t)frameCount*bytesPerFrame) {
+    return false;
+  }
+
+  // Every index has to be in the palette, or drawing would read whatever
+  // comes after it
+  const uint8_t* data = firstFrame;
+  for(int frame = 0; frame < frameCount; frame++) {
+    for(int led = 0; led < ledCount; led++) {
+      uint8_t index = packed ? ((led & 1) ? data[led/2] >> 4 : data[led/2] & 0x0F) : data[led];
+      if(index >= colors) {
+        return false;
+      }
+    }
+    data += bytesPerFrame;
+  }
+
+  return true;
+}
+
 void Animation::reset() {
   frameIndex = 0;
+  seekFrame = 0;
+  seekData = firstFrame;
+  decodedFrame = NO_DECODED_FRAME;
+  cachedKeyframe = NO_KEYFRAME;
 }
 
 void Animation::draw(Pixel* pixels) {
+  drawFrame(frameIndex, pixels);
+
+  frameIndex = (frameIndex + 1)%frameCount;
+};
+
+int Animation::frameLength(const uint8_t* data) {
+  switch(encoding) {
+    case ENCODING_RGB565_RLE:
+      {
+        const uint8_t* run = data;
+        for(int led = 0; led < ledCount; run += 3) {
+          led += run[0];
+        }
+        return run - data;
+      }
+
+    case ENCODING_XOR_DELTA:
+      {
+        int mapLength = (ledCount + 7)/8;
+        int changed = 0;
+        for(int i = 0; i < mapLength; i++) {
+          changed += __builtin_popcount(data[i]);
+        }
+        return mapLength + changed*3;
+      }
+  }
+
+  return 0;
+}
+
+int Animation::keyframeFor(int frame) {
+  if(keyframeInterval == 0) {
+    return 0;
+  }
+  return frame - frame%keyframeInterval;
+}
+
+const uint8_t* Animation::findFrame(int frame) {
   switch(encoding) {
     case ENCODING_RGB24:
-      drawRgb24(pixels);
-      break;
+      return firstFrame + frame*ledCount*3;
+
+    case ENCODING_RGB565:
+      return firstFrame + frame*ledCount*2;
+
+    case ENCODING_INDEXED_4:
+      return firstFrame + frame*((ledCount + 1)/2);
+
+    case ENCODING_INDEXED_8:
+      return firstFrame + frame*ledCount;
   }
 
-  frameIndex = (frameIndex + 1)%frameCount;
+  // Variable length: skip forward from the last frame that was looked up,
+  // if it's on the way, or else from the frame's keyframe
+  int keyframe = keyframeFor(frame);
+  if(frame < seekFrame || seekFrame < keyframe) {
+    seekFrame = keyframe;
+    seekData = firstFrame;
+    if(keyframeInterval != 0) {
+      const uint8_t* offset = keyframeOffsets + keyframe/keyframeInterval*2;
+      seekData += offset[0] | (offset[1] << 8);
+    }
+  }
+  while(seekFrame < frame) {
+    seekData += frameLength(seekData);
+    seekFrame++;
+  }
+  return seekData;
+}
 
-  if(frameIndex > frameCount) {frameIndex = 0;}
-};
+void Animation::drawRgb24(const uint8_t* data, Pixel* pixels) {
+  for(int i = 0; i < ledCount; i++) {
+    pixels[i].R = data[0];
+    pixels[i].G = data[1];
+    pixels[i].B = data[2];
+    data += 3;
+  }
+}
+
+// Widen each field of an RGB565 color to 8 bits, repeating its top bits in
+// the bottom ones so that full scale stays full scale
+static inline void rgb565ToPixel(uint16_t color, Pixel* pixel) {
+  uint8_t r = color >> 11;
+  uint8_t g = (color >> 5) & 0x3F;
+  uint8_t b = color & 0x1F;
+  pixel->R = (r << 3) | (r >> 2);
+  pixel->G = (g << 2) | (g >> 4);
+  pixel->B = (b << 3) | (b >> 2);
+}
+
+void Animation::drawRgb565(const uint8_t* data, Pixel* pixels) {
+  for(int i = 0; i < ledCount; i++) {
+    rgb565ToPixel(data[0] | (data[1] << 8), &pixels[i]);
+    data += 2;
+  }
+}
 
-void Animation::drawRgb24(Pixel* pixels) {
-  currentFrameData = frameData
-    + frameIndex*ledCount*3;  // Offset for current frame
-  
-  for(uint8_t i = 0; i < ledCount; i++) {
-    pixels[i].R = *(currentFrameData+0);
-    pixels[i].G = *(currentFrameData+1);
-    pixels[i].B = *(currentFrameData+2);
+void Animation::drawRgb565Rle(const uint8_t* data, Pixel* pixels) {
+  int i = 0;
+  while(i < ledCount) {
+    int end = i + data[0];
+    rgb565ToPixel(data[1] | (data[2] << 8), &pixels[i]);
+    for(i++; i < end; i++) {
+      pixels[i] = pixels[i - 1];
+    }
+    data += 3;
   }
 }
 
+void Animation::drawIndexed4(const uint8_t* data, Pixel* pixels) {
+  const Pixel* palette = (const Pixel*)(frameData + 1);
+
+  for(int i = 0; i < ledCount; i += 2) {
+    uint8_t indexes = *data++;
+    pixels[i] = palette[indexes & 0x0F];
+    if(i + 1 < ledCount) {
+      pixels[i + 1] = palette[indexes >> 4];
+    }
+  }
+}
+
+void Animation::drawIndexed8(const uint8_t* data, Pixel* pixels) {
+  const Pixel* palette = (const Pixel*)(frameData + 1);
+
+  for(int i = 0; i < ledCount; i++) {
+    pixels[i] = palette[data[i]];
+  }
+}
+
+void Animation::applyXorDelta(const uint8_t* data, Pixel* pixels) {
+  const uint8_t* changes = data + (ledCount + 7)/8;
+
+  for(int i = 0; i < ledCount; i += 8) {
+    for(uint8_t map = *data++; map != 0; map &= map - 1) {
+      Pixel* pixel = &pixels[i + __builtin_ctz(map)];
+      pixel->R ^= changes[0];
+      pixel->G ^= changes[1];
+      pixel->B ^= changes[2];
+      changes += 3;
+    }
+  }
+}
+
+void Animation::drawKeyframe(int keyframe, Pixel* pixels) {
+  if(keyframe == cachedKeyframe) {
+    memcpy(pixels, keyframePixels, ledCount*sizeof(Pixel));
+    return;
+  }
+
+  for(int i = 0; i < ledCount; i++) {
+    pixels[i].R = 0;
+    pixels[i].G = 0;
+    pixels[i].B = 0;
+  }
+  applyXorDelta(findFrame(keyframe), pixels);
+
+  if(ledCount <= LED_COUNT) {
+    memcpy(keyframePixels, pixels, ledCount*sizeof(Pixel));
+    cachedKeyframe = keyframe;
+  }
+}
+
+// XOR is its own inverse, so the pixels can be stepped back a frame as
+// easily as forward. Anything further starts again from the keyframe, so
+// no more than keyframeInterval - 1 deltas are applied.
+void Animation::drawXorDelta(int frame, Pixel* pixels) {
+  int keyframe = keyframeFor(frame);
+
+  if(decodedFrame == frame + 1 && frame + 1 != keyframeFor(frame + 1)) {
+    applyXorDelta(findFrame(decodedFrame), pixels);
+    decodedFrame = frame;
+    return;
+  }
+
+  if(decodedFrame < keyframe || decodedFrame > frame || keyframeFor(decodedFrame) != keyframe) {
+    drawKeyframe(keyframe, pixels);
+    decodedFrame = keyframe;
+  }
+
+  while(decodedFrame < frame) {
+    decodedFrame++;
+    applyXorDelta(findFrame(decodedFrame), pixels);
+  }
+}
+
+void Animation::drawFrame(int frame, Pixel* pixels) {
+  if(frame < 0 || frame >= frameCount) {
+    for(int i = 0; i < ledCount; i++) {
+      pixels[i].R = 0;
+      pixels[i].G = 0;
+      pixels[i].B = 0;
+    }
+    decodedFrame = -1;
+    return;
+  }
 
-uint8_t* Animation::getFrame(int frame) {
   switch(encoding) {
     case ENCODING_RGB24:
-      return frameData + frame*ledCount*3;
+      drawRgb24(findFrame(frame), pixels);
+      break;
+
+    case ENCODING_RGB565:
+      drawRgb565(findFrame(frame), pixels);
       break;
+
+    case ENCODING_RGB565_RLE:
+      drawRgb565Rle(findFrame(frame), pixels);
+      break;
+
+    case ENCODING_INDEXED_4:
+      drawIndexed4(findFrame(frame), pixels);
+      break;
+
+    case ENCODING_INDEXED_8:
+      drawIndexed8(findFrame(frame), pixels);
+      break;
+
+    case ENCODING_XOR_DELTA:
+      drawXorDelta(frame, pixels);
+      return;
+  }
+
+  decodedFrame = frame;
+}
+
+const Pixel* Animation::getFramePixels(int frame, Pixel* buffer) {
+  if(encoding == ENCODING_RGB24 && frame >= 0 && frame < frameCount) {
+    return (const Pixel*)findFrame(frame);
+  }
+
+  drawFrame(frame, buffer);
+  return buffer;
+}
+
+uint8_t* Animation::getFrame(int frame) {
+  if(encoding != ENCODING_RGB24) {
+    return NULL;
   }
 
-  return frameData;
+  return frameData + frame*ledCount*3;
 };
@@ -4,7 +4,35 @@
 #include <stdint.h>
 #include "matrix.h"
 
+// Frame data encodings. Multi-byte values are little endian.
+//
+// RGB24: 3 bytes (R, G, B) per LED.
+// RGB565: 2 bytes per LED, red in the top 5 bits and blue in the bottom 5.
+// RGB565_RLE: Each frame is a list of runs: a count (1 to ledCount) and
+//   the RGB565 color of that many LEDs. Runs don't cross frames.
+// INDEXED_4, INDEXED_8: The data starts with a palette: the number of colors
+//   less one (1 byte), then the RGB24 colors. Each frame is then a palette
+//   index per LED, two to a byte (low nibble first) for INDEXED_4, or a byte
+//   each for INDEXED_8.
+// XOR_DELTA: Each frame is the difference from the one before it (keyframes
+//   are the difference from black): a bitmap of the LEDs that change, LED 0
+//   in the low bit of the first byte, then for each of those LEDs, 3 bytes
+//   to XOR its RGB24 color with.
+//
+// The variable length encodings (RGB565_RLE and XOR_DELTA) start with a
+// keyframe index, so that a frame can be found without decoding the ones
+// before it: the keyframe interval (1 byte), then for each keyframe (frames
+// 0, interval, 2*interval...) the offset of its data from the end of the
+// index (2 bytes).
 #define ENCODING_RGB24       0
+#define ENCODING_RGB565      1
+#define ENCODING_RGB565_RLE  2
+#define ENCODING_INDEXED_4   3
+#define ENCODING_INDEXED_8   4
+#define ENCODING_XOR_DELTA   5
+
+#define NO_DECODED_FRAME    -2      // The pixels don't hold any frame that's known
+#define NO_KEYFRAME         -1      // The keyframe cache is empty
 
 class Animation {
  public:
@@ -15,12 +43,52 @@ class Animation {
 
  private:
   uint8_t encoding;               // Encoding type
-  
+
   int frameIndex;                 // Current animation frame
-  uint8_t* currentFrameData;      // Pointer to the current position in the frame data
 
-  void drawRgb24(Pixel* pixels);
-  void drawRgb16_RLE(Pixel* pixels);
+  const uint8_t* firstFrame;      // Start of frame 0, after any palette or index
+
+  // Keyframe index of the variable length encodings. Seeking jumps to the
+  // keyframe, then skips at most keyframeInterval - 1 frames.
+  uint8_t keyframeInterval;
+  const uint8_t* keyframeOffsets;
+
+  // Where the last frame that was looked up starts. Playing forward only
+  // has to skip the frames in between.
+  int seekFrame;
+  const uint8_t* seekData;
+
+  int decodedFrame;               // Frame that the pixels were last left holding (-1 for blank)
+
+  // The last XOR delta keyframe that was decoded, so that seeking around
+  // near it only has to apply the deltas after it
+  int cachedKeyframe;
+  Pixel keyframePixels[LED_COUNT];
+
+  // @return First frame of the keyframe group that a frame is in
+  int keyframeFor(int frame);
+
+  // Find the start of a frame in the frame data
+  const uint8_t* findFrame(int frame);
+
+  // @return Length of the frame that starts at data, in bytes
+  int frameLength(const uint8_t* data);
+
+  // Check that the palette and the frames of an indexed animation fit, and
+  // that every index is in the palette
+  // @param end End of the frame data
+  bool checkIndexes(const uint8_t* end);
+
+  // Fill the pixels with an XOR delta keyframe
+  void drawKeyframe(int keyframe, Pixel* pixels);
+
+  void drawRgb24(const uint8_t* data, Pixel* pixels);
+  void drawRgb565(const uint8_t* data, Pixel* pixels);
+  void drawRgb565Rle(const uint8_t* data, Pixel* pixels);
+  void drawIndexed4(const uint8_t* data, Pixel* pixels);
+  void drawIndexed8(const uint8_t* data, Pixel* pixels);
+  void applyXorDelta(const uint8_t* data, Pixel* pixels);
+  void drawXorDelta(int frame, Pixel* pixels);
 
  public:
   // Initialize the animation with no data. This is intended for the case
@@ -39,6 +107,37 @@ class Animation {
             const uint8_t ledCount,
             const uint16_t frameDelay);
 
+  // Initialize the animation at compile time, with the layout that init()
+  // would work out already filled in (see animationencoder.py --builtin).
+  // Animations built this way are set up before the sketch starts, without
+  // running any code.
+  // @param firstFrame Start of frame 0 in the frame data
+  // @param keyframeInterval Frames per keyframe, or 0 if there's no index
+  // @param keyframeOffsets Start of the keyframe index, or NULL
+  constexpr Animation(const uint16_t frameCount_,
+                      const uint8_t* frameData_,
+                      const uint8_t encoding_,
+                      const uint8_t ledCount_,
+                      const uint16_t frameDelay_,
+                      const uint8_t* firstFrame_,
+                      const uint8_t keyframeInterval_,
+                      const uint8_t* keyframeOffsets_) :
+    frameData(const_cast<uint8_t*>(frameData_)),
+    ledCount(ledCount_),
+    frameCount(frameCount_),
+    frameDelay(frameDelay_),
+    encoding(encoding_),
+    frameIndex(0),
+    firstFrame(firstFrame_),
+    keyframeInterval(keyframeInterval_),
+    keyframeOffsets(keyframeOffsets_),
+    seekFrame(0),
+    seekData(firstFrame_),
+    decodedFrame(NO_DECODED_FRAME),
+    cachedKeyframe(NO_KEYFRAME),
+    keyframePixels{} {
+  }
+
   // Re-initialize the animation with new information
   // @param frameCount Number of frames in this animation
   // @param frameData Pointer to the frame data. Format of this data is encoding-specficic
@@ -49,15 +148,43 @@ class Animation {
             const uint8_t encoding,
             const uint8_t ledCount,
             const uint16_t frameDelay);
- 
-  // Reset the animation, causing it to start over from frame 0.
+
+  // Check that the frame data is consistent with the encoding and frame
+  // count, and that it fits in a length of flash, so that drawing frames
+  // won't read past it.
+  // @param length Length of the frame data, in bytes
+  // @return false if the animation can't be played
+  bool check(uint32_t length);
+
+  // Reset the animation, causing it to start over from frame 0. Call this
+  // if the pixels were changed behind drawFrame()'s back.
   void reset();
-  
+
   // Draw the next frame of the animation
   // @param strip[] LED strip to draw to.
   void draw(Pixel* pixels);
 
+  // Decode a frame straight from the frame data into a pixel buffer
+  // XOR delta frames are drawn over the last frame, so the same buffer
+  // should be used each time, and left alone in between (or reset() called).
+  // @param frame Frame number (out of range draws blank)
+  // @param pixels Buffer to draw to, ledCount pixels long
+  void drawFrame(int frame, Pixel* pixels);
+
+  // Get a frame's pixels, for encoding straight to the display
+  // (see prepareFrom()). RGB24 frames are used where they are, in flash;
+  // others are decoded into the buffer, as by drawFrame().
+  // @param frame Frame number (out of range gives blank)
+  // @param buffer Buffer to decode to, ledCount pixels long
+  // @return The frame's pixels
+  const Pixel* getFramePixels(int frame, Pixel* buffer);
+
+  // @return Pointer to an RGB24 frame, or NULL if the animation is encoded
+  // some other way (use drawFrame() instead)
   uint8_t* getFrame(int frame);
+
+  // @return Encoding of the frame data
+  uint8_t getEncoding() { return encoding; }
 };
 
 #endif
@@ -1,85 +1,230 @@
 #include "animations.h"
+#include "parameters.h"
+#include "dfu.h"
+
+#define ANIMATION_START ((const uint8_t*)0xA000)
+#define ANIMATION_SIZE  (ANIMATION_BLOCKS*DFU_TRANSFER_SIZE)
+
+AnimationContainer flashAnimations(ANIMATION_START, ANIMATION_SIZE);
+
+#define MAGIC_0_OFFSET          0x0000   // Magic byte 0
+#define MAGIC_1_OFFSET          0x0001   // Magic byte 1
+#define VERSION_OFFSET          0x0002   // Container version (1 byte)
+#define PATTERN_COUNT_OFFSET    0x0003   // Number of patterns in the pattern table (1 byte)
+#define HEADER_CRC_OFFSET       0x0004   // CRC32 of the header and pattern table (4 bytes)
+#define PATTERN_TABLE_OFFSET    0x0008   // Location of the pattern table
+
+#define PATTERN_TABLE_ENTRY_LENGTH      20      // Length of each entry, in bytes
+
+#define FRAME_DATA_OFFSET       0    // Memory location (4 bytes)
+#define FRAME_DATA_LENGTH       4    // Length of the frame data (4 bytes)
+#define FRAME_DATA_CRC          8    // CRC32 of the frame data (4 bytes)
+#define FRAME_COUNT_OFFSET      12   // Frame count (2 bytes)
+#define FRAME_DELAY_OFFSET      14   // Frame delay (2 bytes)
+#define ENCODING_TYPE_OFFSET    16   // Encoding (1 byte)
+#define DISPLAY_MODE_OFFSET     17   // Playback mode (1 byte)
+#define FRAME_WIDTH_OFFSET      18   // LEDs across (1 byte)
+#define FRAME_HEIGHT_OFFSET     19   // LEDs down (1 byte)
+
+// The original layout
+#define LEGACY_MAGIC_0                  (0x31)
+#define LEGACY_MAGIC_1                  (0x23)
+#define LEGACY_PATTERN_COUNT_OFFSET     0x0002   // Number of patterns in the pattern table (1 byte)
+#define LEGACY_DISPLAY_MODE_OFFSET      0x0003   // Playback mode (1 byte)
+#define LEGACY_PATTERN_TABLE_OFFSET     0x0004   // Location of the pattern table
+
+#define LEGACY_PATTERN_TABLE_ENTRY_LENGTH      9        // Length of each entry, in bytes
+
+#define LEGACY_ENCODING_TYPE_OFFSET    0    // Encoding (1 byte)
+#define LEGACY_FRAME_DATA_OFFSET       1    // Memory location, from the end of the pattern table (4 bytes)
+#define LEGACY_FRAME_COUNT_OFFSET      5    // Frame count (2 bytes)
+#define LEGACY_FRAME_DELAY_OFFSET      7    // Frame delay (2 bytes)
+
+static inline uint16_t read16(const uint8_t* data) {
+    return data[0] | (data[1] << 8);
+}
 
-// TODO: Move me to a separate class
-#define ANIMATION_START ((uint8_t*)0xA000)
+static inline uint32_t read32(const uint8_t* data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | (data[3] << 24);
+}
 
-#define MAGIC_0     (0x31)
-#define MAGIC_1     (0x23)
+static inline uint16_t read16BigEndian(const uint8_t* data) {
+    return (data[0] << 8) | data[1];
+}
 
-#define MAGIC_0_PTR       (ANIMATION_START+0x0000)   // Magic byte 0
-#define MAGIC_1_PTR       (ANIMATION_START+0x0001)   // Magic byte 1
-#define PATTERN_COUNT_PTR (ANIMATION_START+0x0002)   // Number of patterns in the pattern table (1 byte)
-#define DISPLAY_MODE_PTR  (ANIMATION_START+0x0003)   // Playback mode (1 byte)
-#define PATTERN_TABLE_PTR (ANIMATION_START+0x0004)   // Location of the pattern table in the flash memory
+static inline uint32_t read32BigEndian(const uint8_t* data) {
+    return (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3];
+}
 
-#define PATTERN_TABLE_ENTRY_LENGTH      9        // Length of each entry, in bytes
-  
-#define ENCODING_TYPE_OFFSET    0    // Encoding (1 byte)
-#define FRAME_DATA_OFFSET       1    // Memory location (4 bytes)
-#define FRAME_COUNT_OFFSET      5    // Frame count (2 bytes)
-#define FRAME_DELAY_OFFSET      7    // Frame delay (2 bytes)
+// CRC32 (the zlib/PNG one), a nibble at a time to keep the table small
+static const uint32_t CRC_TABLE[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+// @param crc CRC of the data before this, to carry on from
+static uint32_t crc32(const uint8_t* data, uint32_t length, uint32_t crc = 0) {
+    crc = ~crc;
+    while(length--) {
+        crc ^= *data++;
+        crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0F];
+        crc = (crc >> 4) ^ CRC_TABLE[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+AnimationContainer::AnimationContainer(const uint8_t* start_, uint32_t size_) :
+    start(start_),
+    size(size_),
+    version(0),
+    patternCount(0) {
+}
 
+const uint8_t* AnimationContainer::patternTable() {
+    if(version == CONTAINER_LEGACY) {
+        return start + LEGACY_PATTERN_TABLE_OFFSET;
+    }
+    return start + PATTERN_TABLE_OFFSET;
+}
+
+void AnimationContainer::validate() {
+    int entries;
+
+    version = 0;
+    patternCount = 0;
+
+    if(start[MAGIC_0_OFFSET] == CONTAINER_MAGIC_0
+       && start[MAGIC_1_OFFSET] == CONTAINER_MAGIC_1
+       && start[VERSION_OFFSET] == CONTAINER_VERSION) {
+        entries = start[PATTERN_COUNT_OFFSET];
+
+        uint32_t crc = crc32(start, HEADER_CRC_OFFSET);
+        crc = crc32(start + PATTERN_TABLE_OFFSET, entries*PATTERN_TABLE_ENTRY_LENGTH, crc);
+        if(crc != read32(start + HEADER_CRC_OFFSET)) {
+            return;
+        }
+        version = CONTAINER_VERSION;
+    }
+    else if(start[MAGIC_0_OFFSET] == LEGACY_MAGIC_0
+            && start[MAGIC_1_OFFSET] == LEGACY_MAGIC_1) {
+        entries = start[LEGACY_PATTERN_COUNT_OFFSET];
+        version = CONTAINER_LEGACY;
+    }
+    else {
+        return;
+    }
 
-#define DISPLAY_MODE_POV       10   // Play back in POV mode
-#define DISPLAY_MODE_TIMED     11   // Play back in timed mode
+    // Patterns that don't check out are skipped, rather than taking the
+    // others with them
+    for(int entry = 0; entry < entries && patternCount < MAX_PATTERNS; entry++) {
+        if(checkPattern(entry)) {
+            patterns[patternCount++] = entry;
+        }
+    }
+}
 
-bool checkHeader() {
-    if(*MAGIC_0_PTR != MAGIC_0) {
-       return false;
+bool AnimationContainer::readPattern(int entry, Animation* animation, uint32_t& length, uint8_t& displayMode) {
+    const uint8_t* table = patternTable();
+    uint32_t offset;
+    uint16_t frameCount;
+    uint16_t frameDelay;
+    uint8_t encoding;
+    uint8_t ledCount;
+    uint32_t tableEnd;
+
+    if(version == CONTAINER_LEGACY) {
+        const uint8_t* pattern = table + entry*LEGACY_PATTERN_TABLE_ENTRY_LENGTH;
+        tableEnd = LEGACY_PATTERN_TABLE_OFFSET
+                 + start[LEGACY_PATTERN_COUNT_OFFSET]*LEGACY_PATTERN_TABLE_ENTRY_LENGTH;
+
+        offset = read32BigEndian(pattern + LEGACY_FRAME_DATA_OFFSET);
+        if(offset > size) {
+            return false;
+        }
+        offset += tableEnd;
+        frameCount = read16BigEndian(pattern + LEGACY_FRAME_COUNT_OFFSET);
+        frameDelay = read16BigEndian(pattern + LEGACY_FRAME_DELAY_OFFSET);
+        encoding = pattern[LEGACY_ENCODING_TYPE_OFFSET];
+        ledCount = LED_COUNT;
+        displayMode = start[LEGACY_DISPLAY_MODE_OFFSET];
+
+        // There's no length, so the pattern can have the rest of the flash
+        length = offset < size ? size - offset : 0;
+    }
+    else {
+        const uint8_t* pattern = table + entry*PATTERN_TABLE_ENTRY_LENGTH;
+        tableEnd = PATTERN_TABLE_OFFSET + start[PATTERN_COUNT_OFFSET]*PATTERN_TABLE_ENTRY_LENGTH;
+
+        offset = read32(pattern + FRAME_DATA_OFFSET);
+        length = read32(pattern + FRAME_DATA_LENGTH);
+        frameCount = read16(pattern + FRAME_COUNT_OFFSET);
+        frameDelay = read16(pattern + FRAME_DELAY_OFFSET);
+        encoding = pattern[ENCODING_TYPE_OFFSET];
+        displayMode = pattern[DISPLAY_MODE_OFFSET];
+
+        // Only the pendant's own layout can be shown
+        if(pattern[FRAME_WIDTH_OFFSET] != LED_COLS || pattern[FRAME_HEIGHT_OFFSET] != LED_ROWS) {
+            return false;
+        }
+        ledCount = LED_COUNT;
     }
 
-    if(*MAGIC_1_PTR != MAGIC_1) {
-       return false;
+    if(offset < tableEnd || offset > size || length > size - offset) {
+        return false;
     }
 
+    animation->init(frameCount, start + offset, encoding, ledCount, frameDelay);
     return true;
 }
 
-/// Get the number of animations stored in the flash
-/// @return animation count, or 0 if no animations present
-unsigned int getAnimationCount() {
-    if(!checkHeader()) {
-        return 0;
+bool AnimationContainer::checkPattern(int entry) {
+    Animation animation;
+    uint32_t length;
+    uint8_t displayMode;
+
+    if(!readPattern(entry, &animation, length, displayMode)) {
+        return false;
     }
 
-    return *PATTERN_COUNT_PTR;
+    if(version != CONTAINER_LEGACY) {
+        if(displayMode != DISPLAYMODE_POV && displayMode != DISPLAYMODE_TIMED) {
+            return false;
+        }
+
+        const uint8_t* pattern = patternTable() + entry*PATTERN_TABLE_ENTRY_LENGTH;
+        if(crc32(animation.frameData, length) != read32(pattern + FRAME_DATA_CRC)) {
+            return false;
+        }
+    }
+
+    return animation.check(length);
+}
+
+unsigned int AnimationContainer::getAnimationCount() {
+    return patternCount;
 }
 
-uint8_t getDisplayMode() {
-    if(!checkHeader()) {
+uint8_t AnimationContainer::getDisplayMode(unsigned int index) {
+    if(index >= patternCount) {
         return 0;
     }
 
-    return *DISPLAY_MODE_PTR;
+    if(version == CONTAINER_LEGACY) {
+        return start[LEGACY_DISPLAY_MODE_OFFSET];
+    }
+
+    return patternTable()[patterns[index]*PATTERN_TABLE_ENTRY_LENGTH + DISPLAY_MODE_OFFSET];
 }
 
-bool loadAnimation(unsigned int index, Animation* animation) {
-    if(index > getAnimationCount()) {
+bool AnimationContainer::loadAnimation(unsigned int index, Animation* animation) {
+    uint32_t length;
+    uint8_t displayMode;
+
+    if(index >= patternCount) {
         return false;
     }
 
-    uint8_t* patternEntryAddress =
-            PATTERN_TABLE_PTR
-            + index * PATTERN_TABLE_ENTRY_LENGTH;
-
-    uint8_t encodingType = *(patternEntryAddress + ENCODING_TYPE_OFFSET);
-    
-    uint8_t *frameData  = PATTERN_TABLE_PTR
-                        + getAnimationCount() * PATTERN_TABLE_ENTRY_LENGTH
-                        + (*(patternEntryAddress + FRAME_DATA_OFFSET + 0) << 24)
-                        + (*(patternEntryAddress + FRAME_DATA_OFFSET + 1) << 16)
-                        + (*(patternEntryAddress + FRAME_DATA_OFFSET + 2) << 8)
-                        + (*(patternEntryAddress + FRAME_DATA_OFFSET + 3) << 0);
- 
-    uint16_t frameCount = (*(patternEntryAddress + FRAME_COUNT_OFFSET    ) << 8)
-                        + (*(patternEntryAddress + FRAME_COUNT_OFFSET + 1) << 0);
-
-    uint16_t frameDelay = (*(patternEntryAddress + FRAME_DELAY_OFFSET    ) << 8)
-                        + (*(patternEntryAddress + FRAME_DELAY_OFFSET + 1) << 0);
- 
-    // TODO: Validation, here or in Animation.init()
-
-    animation->init(frameCount, frameData, encodingType, LED_COUNT, frameDelay);
-
-    return true;
+    return readPattern(patterns[index], animation, length, displayMode);
 }
@@ -1,9 +1,84 @@
+#ifndef ANIMATIONS_H
+#define ANIMATIONS_H
+
 #include "animation.h"
 
-extern unsigned int getAnimationCount();
+// Animation container, at the start of the animation flash. Multi-byte
+// values are little endian, and offsets are from the start of the container.
+//
+// Header (8 bytes):
+//   0  Magic (2 bytes, 'B' 'P')
+//   2  Version (1 byte, CONTAINER_VERSION)
+//   3  Pattern count (1 byte)
+//   4  CRC32 of bytes 0-3 and the pattern table (4 bytes)
+// Pattern table, one entry per pattern (20 bytes each):
+//   0  Frame data offset (4 bytes)
+//   4  Frame data length (4 bytes)
+//   8  CRC32 of the frame data (4 bytes)
+//   12 Frame count (2 bytes)
+//   14 Frame delay, in ms (2 bytes)
+//   16 Encoding (1 byte, see animation.h)
+//   17 Display mode (1 byte, DISPLAYMODE_POV or DISPLAYMODE_TIMED)
+//   18 Frame width and height, in LEDs (1 byte each)
+//
+// The original format (magic 0x31 0x23: a pattern count, a display mode
+// for all of them, and 9 byte big endian pattern table entries) is still
+// read, but it has nothing to check the data against.
+#define CONTAINER_MAGIC_0       'B'
+#define CONTAINER_MAGIC_1       'P'
+#define CONTAINER_VERSION       2
+#define CONTAINER_LEGACY        1       // Version number given to the original format
+
+#define MAX_PATTERNS            64      // Patterns past this are ignored
+
+class AnimationContainer {
+  public:
+    // @param start Start of the container in flash
+    // @param size Space set aside for it, in bytes
+    AnimationContainer(const uint8_t* start, uint32_t size);
+
+    // Check the container and every pattern in it, and remember which ones
+    // can be played, so that switching patterns doesn't have to look again.
+    // Call this at startup, and whenever the flash has been written.
+    void validate();
+
+    // @return Number of patterns that passed validation (0 if there's no
+    // container, or it's damaged)
+    unsigned int getAnimationCount();
+
+    // @return Display mode for a pattern, or 0 if it doesn't exist
+    uint8_t getDisplayMode(unsigned int index);
+
+    // Set up an animation to play a pattern from flash
+    // @return false if the pattern doesn't exist
+    bool loadAnimation(unsigned int index, Animation* animation);
+
+  private:
+    const uint8_t* start;
+    uint32_t size;
+
+    uint8_t version;                    // Container version, or 0 if it's not usable
+    uint8_t patternCount;               // Number of patterns that passed validation
+    uint8_t patterns[MAX_PATTERNS];     // Their positions in the pattern table
+
+    const uint8_t* patternTable();
+
+    // Check one pattern table entry, and its frame data
+    bool checkPattern(int entry);
+
+    // Read a pattern table entry
+    // @return false if the frame data isn't inside the container
+    bool readPattern(int entry, Animation* animation, uint32_t& length, uint8_t& displayMode);
+};
 
-extern unsigned int getPlaybackMode();
+// The container in the animation flash
+extern AnimationContainer flashAnimations;
 
-extern uint8_t getDisplayMode();
+// An animation that's compiled in to the firmware, to play when there's
+// nothing in the animation flash (see animations/builtin.h)
+struct BuiltinAnimation {
+    Animation* animation;
+    uint8_t displayMode;                // DISPLAYMODE_POV or DISPLAYMODE_TIMED
+};
 
-extern bool loadAnimation(unsigned int index, Animation* animation);
+#endif
@@ -1,694 +0,0 @@
-const uint8_t blinkinlabsData[]  = {
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    17, 51, 159, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    17, 51, 159, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    17, 51, 159, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    17, 51, 159, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    17, 51, 159, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    17, 51, 159, // 0
-    17, 51, 159, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    17, 51, 159, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    17, 51, 159, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    17, 51, 159, // 4
-    17, 51, 159, // 5
-    17, 51, 159, // 6
-    17, 51, 159, // 7
-    17, 51, 159, // 8
-    17, 51, 159, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    47, 3, 190, // 0
-    47, 3, 190, // 1
-    47, 3, 190, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    47, 3, 190, // 0
-    47, 3, 190, // 1
-    47, 3, 190, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    47, 3, 190, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    47, 3, 190, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    47, 3, 190, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    47, 3, 190, // 0
-    47, 3, 190, // 1
-    47, 3, 190, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    47, 3, 190, // 0
-    47, 3, 190, // 1
-    47, 3, 190, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    0, 0, 0, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    0, 0, 0, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    47, 3, 190, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    47, 3, 190, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    47, 3, 190, // 6
-    47, 3, 190, // 7
-    47, 3, 190, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    47, 3, 190, // 3
-    47, 3, 190, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-    0, 0, 0, // 0
-    0, 0, 0, // 1
-    0, 0, 0, // 2
-    0, 0, 0, // 3
-    0, 0, 0, // 4
-    0, 0, 0, // 5
-    0, 0, 0, // 6
-    0, 0, 0, // 7
-    0, 0, 0, // 8
-    0, 0, 0, // 9
-};
-
-Animation blinkinlabsAnimation(69, blinkinlabsData, ENCODING_RGB24, 10, 50);
@@ -39,10 +39,17 @@
 #define ACCELEROMETER_INT   9   // Accelerometer input, PTC3. Note this interrupt bank needs to be set to low priority.
 
 
+// Accelerometer orientations that the pendant is hanging in. It hangs with
+// Y pointing up, which the accelerometer calls portrait down (see mma8653.h).
+#define ORIENTATION_UPRIGHT     MMA8653_PORTRAIT_DOWN
+#define ORIENTATION_UPSIDE_DOWN MMA8653_PORTRAIT_UP
+
 #define DISPLAYMODE_POV     10  // POV mode- use acelerometer to display image
 #define DISPLAYMODE_TIMED   11  // Timed mode- play back at the pattern speed
 #define DISPLAYMODE_SERIALLOOP 255  // Serial mode- stream data from computer
 
+#define POV_BIT_DEPTH       6   // Color bits per channel in POV mode, for a faster refresh
+
 
 // Fadecandy interface defines (stubs)
 #define LUT_CH_SIZE             1
@@ -1,6 +1,6 @@
 // This table was automatically generated using 'make_brightness_table.py'
 // input bit depth: 8
-// output bit depth: 8
+// output bit depth: 16
 
 #ifndef BRIGHTNESS_TABLE_H
 #define BRIGHTNESS_TABLE_H
@@ -9,261 +9,261 @@
 
 const uint16_t brightnessTable[BRIGHTNESS_STEPS] = {
          0, // 0
-         0, // 1
-         0, // 2
-         0, // 3
-         0, // 4
-         0, // 5
-         0, // 6
-         0, // 7
-         0, // 8
-         0, // 9
-         0, // 10
-         0, // 11
-         0, // 12
-         0, // 13
-         0, // 14
-         0, // 15
-         1, // 16
-         1, // 17
-         1, // 18
-         1, // 19
-         1, // 20
-         1, // 21
-         1, // 22
-         2, // 23
-         2, // 24
-         2, // 25
-         2, // 26
-         2, // 27
-         3, // 28
-         3, // 29
-         3, // 30
-         3, // 31
-         4, // 32
-         4, // 33
-         4, // 34
-         4, // 35
-         5, // 36
-         5, // 37
-         5, // 38
-         5, // 39
-         6, // 40
-         6, // 41
-         6, // 42
-         7, // 43
-         7, // 44
-         7, // 45
-         8, // 46
-         8, // 47
-         9, // 48
-         9, // 49
-         9, // 50
-        10, // 51
-        10, // 52
-        10, // 53
-        11, // 54
-        11, // 55
-        12, // 56
-        12, // 57
-        13, // 58
-        13, // 59
-        14, // 60
-        14, // 61
-        15, // 62
-        15, // 63
-        16, // 64
-        16, // 65
-        17, // 66
-        17, // 67
-        18, // 68
-        18, // 69
-        19, // 70
-        19, // 71
-        20, // 72
-        20, // 73
-        21, // 74
-        21, // 75
-        22, // 76
-        23, // 77
-        23, // 78
-        24, // 79
-        25, // 80
-        25, // 81
-        26, // 82
-        26, // 83
-        27, // 84
-        28, // 85
-        28, // 86
-        29, // 87
-        30, // 88
-        30, // 89
-        31, // 90
-        32, // 91
-        33, // 92
-        33, // 93
-        34, // 94
-        35, // 95
-        36, // 96
-        36, // 97
-        37, // 98
-        38, // 99
-        39, // 100
-        39, // 101
-        40, // 102
-        41, // 103
-        42, // 104
-        43, // 105
-        43, // 106
-        44, // 107
-        45, // 108
-        46, // 109
-        47, // 110
-        48, // 111
-        49, // 112
-        49, // 113
-        50, // 114
-        51, // 115
-        52, // 116
-        53, // 117
-        54, // 118
-        55, // 119
-        56, // 120
-        57, // 121
-        58, // 122
-        59, // 123
-        60, // 124
-        61, // 125
-        62, // 126
-        63, // 127
-        64, // 128
-        65, // 129
-        66, // 130
-        67, // 131
-        68, // 132
-        69, // 133
-        70, // 134
-        71, // 135
-        72, // 136
-        73, // 137
-        74, // 138
-        75, // 139
-        76, // 140
-        77, // 141
-        78, // 142
-        79, // 143
-        81, // 144
-        82, // 145
-        83, // 146
-        84, // 147
-        85, // 148
-        86, // 149
-        87, // 150
-        89, // 151
-        90, // 152
-        91, // 153
-        92, // 154
-        93, // 155
-        95, // 156
-        96, // 157
-        97, // 158
-        98, // 159
-       100, // 160
-       101, // 161
-       102, // 162
-       103, // 163
-       105, // 164
-       106, // 165
-       107, // 166
-       108, // 167
-       110, // 168
-       111, // 169
-       112, // 170
-       114, // 171
-       115, // 172
-       116, // 173
-       118, // 174
-       119, // 175
-       121, // 176
-       122, // 177
-       123, // 178
-       125, // 179
-       126, // 180
-       127, // 181
-       129, // 182
-       130, // 183
-       132, // 184
-       133, // 185
-       135, // 186
-       136, // 187
-       138, // 188
-       139, // 189
-       141, // 190
-       142, // 191
-       144, // 192
-       145, // 193
-       147, // 194
-       148, // 195
-       150, // 196
-       151, // 197
-       153, // 198
-       154, // 199
-       156, // 200
-       157, // 201
-       159, // 202
-       160, // 203
-       162, // 204
-       164, // 205
-       165, // 206
-       167, // 207
-       169, // 208
-       170, // 209
-       172, // 210
-       173, // 211
-       175, // 212
-       177, // 213
-       178, // 214
-       180, // 215
-       182, // 216
-       183, // 217
-       185, // 218
-       187, // 219
-       189, // 220
-       190, // 221
-       192, // 222
-       194, // 223
-       196, // 224
-       197, // 225
-       199, // 226
-       201, // 227
-       203, // 228
-       204, // 229
-       206, // 230
-       208, // 231
-       210, // 232
-       212, // 233
-       213, // 234
-       215, // 235
-       217, // 236
-       219, // 237
-       221, // 238
-       223, // 239
-       225, // 240
-       226, // 241
-       228, // 242
-       230, // 243
-       232, // 244
-       234, // 245
-       236, // 246
-       238, // 247
-       240, // 248
-       242, // 249
-       244, // 250
-       246, // 251
-       248, // 252
-       250, // 253
-       252, // 254
-       254, // 255
+         1, // 1
+         4, // 2
+         9, // 3
+        16, // 4
+        25, // 5
+        36, // 6
+        49, // 7
+        64, // 8
+        81, // 9
+       100, // 10
+       121, // 11
+       144, // 12
+       169, // 13
+       196, // 14
+       225, // 15
+       256, // 16
+       289, // 17
+       324, // 18
+       361, // 19
+       400, // 20
+       441, // 21
+       484, // 22
+       529, // 23
+       576, // 24
+       625, // 25
+       676, // 26
+       729, // 27
+       784, // 28
+       841, // 29
+       900, // 30
+       961, // 31
+      1024, // 32
+      1089, // 33
+      1156, // 34
+      1225, // 35
+      1296, // 36
+      1369, // 37
+      1444, // 38
+      1521, // 39
+      1600, // 40
+      1681, // 41
+      1764, // 42
+      1849, // 43
+      1936, // 44
+      2025, // 45
+      2116, // 46
+      2209, // 47
+      2304, // 48
+      2401, // 49
+      2500, // 50
+      2601, // 51
+      2704, // 52
+      2809, // 53
+      2916, // 54
+      3025, // 55
+      3136, // 56
+      3249, // 57
+      3364, // 58
+      3481, // 59
+      3600, // 60
+      3721, // 61
+      3844, // 62
+      3969, // 63
+      4096, // 64
+      4225, // 65
+      4356, // 66
+      4489, // 67
+      4624, // 68
+      4761, // 69
+      4900, // 70
+      5041, // 71
+      5184, // 72
+      5329, // 73
+      5476, // 74
+      5625, // 75
+      5776, // 76
+      5929, // 77
+      6084, // 78
+      6241, // 79
+      6400, // 80
+      6561, // 81
+      6724, // 82
+      6889, // 83
+      7056, // 84
+      7225, // 85
+      7396, // 86
+      7569, // 87
+      7744, // 88
+      7921, // 89
+      8100, // 90
+      8281, // 91
+      8464, // 92
+      8649, // 93
+      8836, // 94
+      9025, // 95
+      9216, // 96
+      9409, // 97
+      9604, // 98
+      9801, // 99
+     10000, // 100
+     10201, // 101
+     10404, // 102
+     10609, // 103
+     10816, // 104
+     11025, // 105
+     11236, // 106
+     11449, // 107
+     11664, // 108
+     11881, // 109
+     12100, // 110
+     12321, // 111
+     12544, // 112
+     12769, // 113
+     12996, // 114
+     13225, // 115
+     13456, // 116
+     13689, // 117
+     13924, // 118
+     14161, // 119
+     14400, // 120
+     14641, // 121
+     14884, // 122
+     15129, // 123
+     15376, // 124
+     15625, // 125
+     15876, // 126
+     16129, // 127
+     16384, // 128
+     16641, // 129
+     16900, // 130
+     17161, // 131
+     17424, // 132
+     17689, // 133
+     17956, // 134
+     18225, // 135
+     18496, // 136
+     18769, // 137
+     19044, // 138
+     19321, // 139
+     19600, // 140
+     19881, // 141
+     20164, // 142
+     20449, // 143
+     20736, // 144
+     21025, // 145
+     21316, // 146
+     21609, // 147
+     21904, // 148
+     22201, // 149
+     22500, // 150
+     22801, // 151
+     23104, // 152
+     23409, // 153
+     23716, // 154
+     24025, // 155
+     24336, // 156
+     24649, // 157
+     24964, // 158
+     25281, // 159
+     25600, // 160
+     25921, // 161
+     26244, // 162
+     26569, // 163
+     26896, // 164
+     27225, // 165
+     27556, // 166
+     27889, // 167
+     28224, // 168
+     28561, // 169
+     28900, // 170
+     29241, // 171
+     29584, // 172
+     29929, // 173
+     30276, // 174
+     30625, // 175
+     30976, // 176
+     31329, // 177
+     31684, // 178
+     32041, // 179
+     32400, // 180
+     32761, // 181
+     33124, // 182
+     33489, // 183
+     33856, // 184
+     34225, // 185
+     34596, // 186
+     34969, // 187
+     35344, // 188
+     35721, // 189
+     36100, // 190
+     36481, // 191
+     36864, // 192
+     37249, // 193
+     37636, // 194
+     38025, // 195
+     38416, // 196
+     38809, // 197
+     39204, // 198
+     39601, // 199
+     40000, // 200
+     40401, // 201
+     40804, // 202
+     41209, // 203
+     41616, // 204
+     42025, // 205
+     42436, // 206
+     42849, // 207
+     43264, // 208
+     43681, // 209
+     44100, // 210
+     44521, // 211
+     44944, // 212
+     45369, // 213
+     45796, // 214
+     46225, // 215
+     46656, // 216
+     47089, // 217
+     47524, // 218
+     47961, // 219
+     48400, // 220
+     48841, // 221
+     49284, // 222
+     49729, // 223
+     50176, // 224
+     50625, // 225
+     51076, // 226
+     51529, // 227
+     51984, // 228
+     52441, // 229
+     52900, // 230
+     53361, // 231
+     53824, // 232
+     54289, // 233
+     54756, // 234
+     55225, // 235
+     55696, // 236
+     56169, // 237
+     56644, // 238
+     57121, // 239
+     57600, // 240
+     58081, // 241
+     58564, // 242
+     59049, // 243
+     59536, // 244
+     60025, // 245
+     60516, // 246
+     61009, // 247
+     61504, // 248
+     62001, // 249
+     62500, // 250
+     63001, // 251
+     63504, // 252
+     64009, // 253
+     64516, // 254
+     65025, // 255
 };
 
 #endif
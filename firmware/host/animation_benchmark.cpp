@@ -0,0 +1,313 @@
+/*
+ * Host benchmark for the animation decoders
+ *
+ * Decodes the sample animation from each of its encodings (generated into
+ * animation_data.h by animationencoder.py), checking every frame against
+ * the RGB24 original, played forward, backward and in a random order. The
+ * variable length encodings are also run without their keyframe index
+ * (animation_unindexed.h), to show what it saves on seeks.
+ *
+ * Also checks that the animation container validation (animations.cpp)
+ * accepts a good container (animation_container.h) and the original
+ * format, and drops patterns that are damaged or don't fit, or that index
+ * past their palette. The animations built in to the firmware
+ * (animations/builtin.h), which are laid out at compile time, have to play
+ * the same as if init() had set them up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "animation.h"
+#include "animations.h"
+#include "animation_data.h"
+#include "animation_unindexed.h"
+#include "animation_container.h"
+#include "animations/builtin.h"
+
+#define ITERATIONS 100000
+
+#define CONTAINER_SIZE (23*1024)
+
+struct Encoded {
+  const char* name;
+  Animation* animation;
+  int size;
+  bool lossy;                     // Only the top bits of each color are kept
+};
+
+static Encoded encodings[] = {
+  {"RGB24",      &sample_rgb24Animation,      sizeof(sample_rgb24Data),      false},
+  {"INDEXED_4",  &sample_indexed_4Animation,  sizeof(sample_indexed_4Data),  false},
+  {"INDEXED_8",  &sample_indexed_8Animation,  sizeof(sample_indexed_8Data),  false},
+  {"XOR_DELTA",  &sample_xor_deltaAnimation,  sizeof(sample_xor_deltaData),  false},
+  {"RGB565",     &sample_rgb565Animation,     sizeof(sample_rgb565Data),     true},
+  {"RGB565_RLE", &sample_rgb565_rleAnimation, sizeof(sample_rgb565_rleData), true},
+  {"XOR_DELTA (no index)",  &unindexed_xor_deltaAnimation,  sizeof(unindexed_xor_deltaData),  false},
+  {"RGB565_RLE (no index)", &unindexed_rgb565_rleAnimation, sizeof(unindexed_rgb565_rleData), true},
+};
+
+#define ENCODING_COUNT (sizeof(encodings)/sizeof(encodings[0]))
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// RGB565 keeps the top 5 or 6 bits of each color
+static bool matches(const Pixel& pixel, const uint8_t* expected, bool lossy) {
+  if(!lossy) {
+    return pixel.R == expected[0] && pixel.G == expected[1] && pixel.B == expected[2];
+  }
+  return (pixel.R >> 3) == (expected[0] >> 3)
+      && (pixel.G >> 2) == (expected[1] >> 2)
+      && (pixel.B >> 3) == (expected[2] >> 3);
+}
+
+// Draw a sequence of frames, checking each one against the original
+static bool check(Encoded& encoded, const int* frames, int count) {
+  Animation* animation = encoded.animation;
+  Pixel pixels[256];
+
+  animation->reset();
+  for(int i = 0; i < count; i++) {
+    animation->drawFrame(frames[i], pixels);
+    const uint8_t* expected = sample_rgb24Animation.getFrame(frames[i]);
+    for(int led = 0; led < animation->ledCount; led++) {
+      if(!matches(pixels[led], expected + led*3, encoded.lossy)) {
+        printf("%s: frame %i, LED %i is %i,%i,%i, expected %i,%i,%i\n",
+               encoded.name, frames[i], led, pixels[led].R, pixels[led].G, pixels[led].B,
+               expected[led*3 + 0], expected[led*3 + 1], expected[led*3 + 2]);
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// Time drawing a sequence of frames, returning the average time per frame
+// in nanoseconds
+static double timeFrames(Encoded& encoded, const int* frames, int count) {
+  Pixel pixels[256];
+
+  encoded.animation->reset();
+  double start = now();
+  for(int i = 0; i < ITERATIONS; i++) {
+    encoded.animation->drawFrame(frames[i % count], pixels);
+  }
+  return (now() - start)*1e9/ITERATIONS;
+}
+
+static uint8_t flash[CONTAINER_SIZE];
+
+// Put an image in the simulated flash, with the rest erased
+static void writeFlash(const uint8_t* image, int length) {
+  memset(flash, 0xFF, sizeof(flash));
+  memcpy(flash, image, length);
+}
+
+// Validate the simulated flash, checking how many patterns pass
+static bool checkValidation(const char* name, unsigned int expected) {
+  AnimationContainer container(flash, sizeof(flash));
+  container.validate();
+  if(container.getAnimationCount() != expected) {
+    printf("Container (%s): %i patterns passed, expected %i\n", name, container.getAnimationCount(), expected);
+    return false;
+  }
+  return true;
+}
+
+static bool checkContainers(const int* frames, int count) {
+  AnimationContainer container(flash, sizeof(flash));
+  Animation animation;
+
+  writeFlash(sampleContainer, sizeof(sampleContainer));
+  container.validate();
+  if(container.getAnimationCount() != 2
+     || container.getDisplayMode(0) != DISPLAYMODE_TIMED
+     || container.loadAnimation(2, &animation)) {
+    printf("Container: expected 2 timed patterns\n");
+    return false;
+  }
+  for(int i = 0; i < 2; i++) {
+    Encoded encoded = {"container", &animation, 0, false};
+    if(!container.loadAnimation(i, &animation) || !check(encoded, frames, count)) {
+      return false;
+    }
+  }
+
+  // Damage the second pattern's frame data, then the pattern table
+  uint32_t offset = flash[8 + 20] | (flash[8 + 21] << 8);
+  flash[offset + 5] ^= 0x01;
+  if(!checkValidation("damaged pattern", 1)) {
+    return false;
+  }
+  flash[8 + 14] ^= 0x01;
+  if(!checkValidation("damaged table", 0)) {
+    return false;
+  }
+
+  memset(flash, 0xFF, sizeof(flash));
+  if(!checkValidation("erased", 0)) {
+    return false;
+  }
+
+  // The original format: one RGB24 pattern, straight after the table
+  int frameCount = sample_rgb24Animation.frameCount;
+  uint8_t legacy[4 + 9] = {0x31, 0x23, 1, DISPLAYMODE_POV,
+                           ENCODING_RGB24, 0, 0, 0, 0,
+                           (uint8_t)(frameCount >> 8), (uint8_t)frameCount, 0, 50};
+  writeFlash(legacy, sizeof(legacy));
+  memcpy(flash + sizeof(legacy), sample_rgb24Data, sizeof(sample_rgb24Data));
+  container.validate();
+  Encoded encoded = {"legacy container", &animation, 0, false};
+  if(container.getAnimationCount() != 1
+     || container.getDisplayMode(0) != DISPLAYMODE_POV
+     || !container.loadAnimation(0, &animation)
+     || !check(encoded, frames, count)) {
+    printf("Container: original format not read back\n");
+    return false;
+  }
+
+  // More frames than there's flash for
+  flash[9] = 0xFF;
+  if(!checkValidation("too many frames", 0)) {
+    return false;
+  }
+
+  return true;
+}
+
+// Indexed frames that point past the end of the palette have to be turned
+// away, rather than drawn from whatever follows it
+static bool checkPaletteIndexes() {
+  // Two colors, then two frames of 3 LEDs
+  uint8_t indexed4[] = {1, 10, 20, 30, 40, 50, 60,
+                        0x10, 0x01, 0x01, 0x00};
+  uint8_t indexed8[] = {1, 10, 20, 30, 40, 50, 60,
+                        0, 1, 0, 1, 1, 0};
+  Animation animation;
+
+  // The unused top nibble of each INDEXED_4 frame doesn't count
+  indexed4[8] = 0xF1;
+  animation.init(2, indexed4, ENCODING_INDEXED_4, 3, 50);
+  if(!animation.check(sizeof(indexed4))) {
+    printf("Palette: good INDEXED_4 frames turned away\n");
+    return false;
+  }
+  animation.init(2, indexed8, ENCODING_INDEXED_8, 3, 50);
+  if(!animation.check(sizeof(indexed8))) {
+    printf("Palette: good INDEXED_8 frames turned away\n");
+    return false;
+  }
+
+  indexed4[9] = 0x02;
+  animation.init(2, indexed4, ENCODING_INDEXED_4, 3, 50);
+  if(animation.check(sizeof(indexed4))) {
+    printf("Palette: INDEXED_4 index past the palette accepted\n");
+    return false;
+  }
+  indexed8[12] = 0xFF;
+  animation.init(2, indexed8, ENCODING_INDEXED_8, 3, 50);
+  if(animation.check(sizeof(indexed8))) {
+    printf("Palette: INDEXED_8 index past the palette accepted\n");
+    return false;
+  }
+
+  // A palette that runs past the end of the data
+  indexed8[12] = 0;
+  indexed8[0] = 200;
+  animation.init(2, indexed8, ENCODING_INDEXED_8, 3, 50);
+  if(animation.check(sizeof(indexed8))) {
+    printf("Palette: palette past the end of the data accepted\n");
+    return false;
+  }
+
+  return true;
+}
+
+// Play each built in animation next to a copy that init() set up from the
+// same data
+static bool checkBuiltins() {
+  Pixel expected[LED_COUNT];
+  Pixel pixels[LED_COUNT];
+
+  for(int i = 0; i < BUILTIN_ANIMATION_COUNT; i++) {
+    Animation* builtin = builtinAnimations[i].animation;
+    Animation animation(builtin->frameCount, builtin->frameData, builtin->getEncoding(),
+                        builtin->ledCount, builtin->frameDelay);
+
+    if(builtinAnimations[i].displayMode != DISPLAYMODE_POV
+       && builtinAnimations[i].displayMode != DISPLAYMODE_TIMED) {
+      printf("Built in animation %i: bad display mode\n", i);
+      return false;
+    }
+
+    // Backward, so that the variable length encodings have to seek
+    for(int frame = builtin->frameCount - 1; frame >= 0; frame--) {
+      animation.drawFrame(frame, expected);
+      builtin->drawFrame(frame, pixels);
+      if(memcmp(pixels, expected, sizeof(pixels)) != 0) {
+        printf("Built in animation %i: frame %i doesn't match\n", i, frame);
+        return false;
+      }
+    }
+  }
+
+  // The first is the sample animation
+  Encoded encoded = {"built in", builtinAnimations[0].animation, 0, false};
+  int frameCount = sample_rgb24Animation.frameCount;
+  int* frames = new int[frameCount];
+  for(int i = 0; i < frameCount; i++) {
+    frames[i] = i;
+  }
+  bool matched = check(encoded, frames, frameCount);
+  delete[] frames;
+  return matched;
+}
+
+int main() {
+  int frameCount = sample_rgb24Animation.frameCount;
+  int* forward = new int[frameCount];
+  int* backward = new int[frameCount];
+  int* shuffled = new int[frameCount];
+
+  for(int i = 0; i < frameCount; i++) {
+    forward[i] = i;
+    backward[i] = frameCount - 1 - i;
+    shuffled[i] = i;
+  }
+  srand(1);
+  for(int i = frameCount - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    int swap = shuffled[i];
+    shuffled[i] = shuffled[j];
+    shuffled[j] = swap;
+  }
+
+  for(int i = 0; i < ENCODING_COUNT; i++) {
+    if(!check(encodings[i], forward, frameCount)
+       || !check(encodings[i], backward, frameCount)
+       || !check(encodings[i], shuffled, frameCount)) {
+      return 1;
+    }
+  }
+
+  if(!checkContainers(forward, frameCount) || !checkPaletteIndexes() || !checkBuiltins()) {
+    return 1;
+  }
+
+  printf("Animation decoders, %i frames of %i LEDs, %i iterations\n",
+         frameCount, sample_rgb24Animation.ledCount, ITERATIONS);
+  printf("  %-21s %6s %11s %11s %11s\n", "encoding", "bytes", "forward", "backward", "random");
+  for(int i = 0; i < ENCODING_COUNT; i++) {
+    printf("  %-21s %6i %8.1f ns %8.1f ns %8.1f ns\n", encodings[i].name, encodings[i].size,
+           timeFrames(encodings[i], forward, frameCount),
+           timeFrames(encodings[i], backward, frameCount),
+           timeFrames(encodings[i], shuffled, frameCount));
+  }
+
+  return 0;
+}
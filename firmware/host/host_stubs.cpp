@@ -0,0 +1,162 @@
+/*
+ * Stand-ins for the Teensyduino core, for host builds
+ *
+ * The display code only uses the core library for setup and bookkeeping,
+ * so these don't need to do anything. Time comes from the simulator (see
+ * simulator.h), and stands still when it isn't running.
+ */
+
+#include "WProgram.h"
+#include "mma8653.h"
+#include "parameters.h"
+
+uint64_t hostTicks;                         // Simulated time, in FTM0 ticks (F_BUS/2)
+float hostAcceleration[3];                  // Simulated accelerometer reading, in m/s^2
+bool hostMotionEvent;                       // The motion detector is holding the interrupt pin low
+
+extern "C" {
+
+volatile uint32_t systick_millis_count;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void attachInterrupt(uint8_t pin, void (*function)(void), int mode) {
+}
+
+uint32_t micros(void) {
+    return hostTicks/((F_BUS/2)/1000000);
+}
+
+}
+
+static uint8_t hostRange = MMA8653_RANGE_8G;
+static bool hostHighResolution = true;
+
+void MMA8653::setup(uint8_t range, uint8_t rate, bool highResolution, uint32_t busSpeed) {
+    hostRange = range;
+    hostHighResolution = highResolution;
+
+    // Reading the motion event lets the interrupt pin go, and reads finish
+    // straight away, so the pin isn't left low after that
+    hostMotionEvent = false;
+    CORE_PIN9_PINREG |= CORE_PIN9_BITMASK;  // ACCELEROMETER_INT
+}
+
+// The motion detector goes off while the pendant is asleep
+void hostMotion() {
+    hostMotionEvent = true;
+    CORE_PIN9_PINREG &= ~CORE_PIN9_BITMASK;
+}
+
+// Reads come back with the same resolution as the real thing (10 or 8 bits,
+// at the selected range), as a left justified output register value
+static int32_t accelerometerReading(float acceleration) {
+    const float g = 9.8;                    // m/s^2
+    int bits = hostHighResolution ? 10 : 8;
+    int limit = 1 << (bits - 1);
+
+    int count = lroundf(acceleration/g*(limit >> (hostRange + 1)));
+    if(count > limit - 1) {
+        count = limit - 1;
+    }
+    else if(count < -limit) {
+        count = -limit;
+    }
+    return MMA8653::toAcceleration(count*(1 << (16 - bits)), hostRange);
+}
+
+bool MMA8653::getXYZ(int32_t& X, int32_t& Y, int32_t& Z) {
+    X = accelerometerReading(hostAcceleration[0]);
+    Y = accelerometerReading(hostAcceleration[1]);
+    Z = accelerometerReading(hostAcceleration[2]);
+    return true;
+}
+
+// There's no bus to wait on, so background reads finish straight away,
+// unless one is started from the callback of another (as the sample and
+// orientation callbacks do while the interrupt pin is low). That one is left
+// for the I2C interrupt, which comes round each time busy() is asked.
+static bool inCallback;
+static MMA8653::SampleCallback pendingSample;
+static MMA8653::OrientationCallback pendingOrientation;
+
+static void finishSample(MMA8653::SampleCallback callback) {
+    int32_t X = accelerometerReading(hostAcceleration[0]);
+    int32_t Y = accelerometerReading(hostAcceleration[1]);
+    int32_t Z = accelerometerReading(hostAcceleration[2]);
+    inCallback = true;
+    callback(X, Y, Z);
+    inCallback = false;
+}
+
+// Portrait or landscape, whichever axis gravity is pulling hardest on
+static void finishOrientation(MMA8653::OrientationCallback callback) {
+    uint8_t orientation;
+    if(fabsf(hostAcceleration[1]) >= fabsf(hostAcceleration[0])) {
+        orientation = hostAcceleration[1] < 0 ? MMA8653_PORTRAIT_UP : MMA8653_PORTRAIT_DOWN;
+    }
+    else {
+        orientation = hostAcceleration[0] > 0 ? MMA8653_LANDSCAPE_RIGHT : MMA8653_LANDSCAPE_LEFT;
+    }
+    inCallback = true;
+    callback(orientation);
+    inCallback = false;
+}
+
+bool MMA8653::busy() {
+    if(pendingSample) {
+        SampleCallback callback = pendingSample;
+        pendingSample = NULL;
+        finishSample(callback);
+        return true;
+    }
+    if(pendingOrientation) {
+        OrientationCallback callback = pendingOrientation;
+        pendingOrientation = NULL;
+        finishOrientation(callback);
+        return true;
+    }
+    return false;
+}
+
+bool MMA8653::stopReads() {
+    pendingSample = NULL;
+    pendingOrientation = NULL;
+    return true;
+}
+
+bool MMA8653::startRead(SampleCallback callback) {
+    if(pendingSample || pendingOrientation) {
+        return false;
+    }
+    if(inCallback) {
+        pendingSample = callback;
+    }
+    else {
+        finishSample(callback);
+    }
+    return true;
+}
+
+bool MMA8653::startOrientationRead(OrientationCallback callback) {
+    if(pendingSample || pendingOrientation) {
+        return false;
+    }
+    if(inCallback) {
+        pendingOrientation = callback;
+    }
+    else {
+        finishOrientation(callback);
+    }
+    return true;
+}
+
+// There's nothing to wake up from
+void MMA8653::sleep(const int32_t rest[3]) {
+}
+
+// There's no flash, so the POV code always starts with its defaults
+bool loadParameters(POVParameters& parameters) {
+    return false;
+}
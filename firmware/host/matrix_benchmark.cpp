@@ -0,0 +1,255 @@
+/*
+ * Host benchmark for the DMA matrix encoder
+ *
+ * Compares pixelsToDmaBuffer() against the original per-bit encoder that it
+ * replaced, checking that both produce the same waveform, and that the
+ * dithered output averages out to the full resolution color.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#include "matrix.h"
+
+#define DMA_DAT_SHIFT   6
+#define DMA_CLK_SHIFT   5
+
+#define ROW_BIT_SIZE (LED_COLS*BYTES_PER_PIXEL*2)
+#define ROW_DEPTH_SIZE (ROW_BIT_SIZE*MAX_BIT_DEPTH)
+#define PANEL_DEPTH_SIZE (ROW_DEPTH_SIZE*LED_ROWS)
+
+// Size of the firmware's DMA buffers, which have room for split bit planes
+#define MAX_ROW_SLOTS (MAX_BIT_DEPTH + 4)
+#define DMA_BUFFER_SIZE (ROW_BIT_SIZE*MAX_ROW_SLOTS*LED_ROWS)
+
+#define ITERATIONS 1000000
+
+extern uint8_t OUTPUT_ORDER[];
+extern Pixel pixels[];
+extern uint16_t staleChannels[][LED_ROWS];
+extern uint16_t colorTables[][256];
+extern uint8_t dmaBuffer[][DMA_BUFFER_SIZE];
+extern uint8_t slotRows[];
+extern uint8_t slotPlanes[];
+extern int rowSlots;
+extern bool planeInterleaving;
+extern volatile int ditherBuffer;
+extern void fillSchedule();
+extern void markAllStale();
+extern void fillColorTables();
+extern void pixelsToDmaBuffer(const Pixel* pixelInput, uint8_t bufferOutput[]);
+extern void updateDmaBuffer(Pixel* pixelInput, int buffer);
+
+// Encoder as it was before the table-driven transpose (plus color correction)
+void referencePixelsToDmaBuffer(const Pixel* pixelInput, uint8_t bufferOutput[]) {
+  for(int row = 0; row < LED_ROWS; row++) {
+    for(int col = 0; col < LED_COLS; col++) {
+      int data_R = colorTables[0][pixelInput[row*LED_COLS + col].R] >> 8;
+      int data_G = colorTables[1][pixelInput[row*LED_COLS + col].G] >> 8;
+      int data_B = colorTables[2][pixelInput[row*LED_COLS + col].B] >> 8;
+
+      for(int depth = 0; depth < MAX_BIT_DEPTH; depth++) {
+        uint8_t output_r = (((data_R >> depth) & 0x01) << DMA_DAT_SHIFT);
+        uint8_t output_g = (((data_G >> depth) & 0x01) << DMA_DAT_SHIFT);
+        uint8_t output_b = (((data_B >> depth) & 0x01) << DMA_DAT_SHIFT);
+
+        int offset_r = OUTPUT_ORDER[col*3 + 0];
+        int offset_g = OUTPUT_ORDER[col*3 + 1];
+        int offset_b = OUTPUT_ORDER[col*3 + 2];
+
+        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_r*2 + 0] = output_r;
+        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_r*2 + 1] = output_r | 1 << DMA_CLK_SHIFT;
+        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_g*2 + 0] = output_g;
+        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_g*2 + 1] = output_g | 1 << DMA_CLK_SHIFT;
+        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_b*2 + 0] = output_b;
+        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_b*2 + 1] = output_b | 1 << DMA_CLK_SHIFT;
+      }
+    }
+  }
+
+  for(int pos= 0; pos < PANEL_DEPTH_SIZE/2; pos++) {
+        bufferOutput[pos*2 + 1] |= 1 << DMA_CLK_SHIFT;
+  }
+}
+
+// Read back the bitDepth-bit value of a channel from an encoded buffer
+static int decodeChannel(const uint8_t* buffer, int row, int channel) {
+  int value = 0;
+  for(int depth = 0; depth < getBitDepth(); depth++) {
+    uint8_t out = buffer[row*ROW_BIT_SIZE*getBitDepth() + depth*ROW_BIT_SIZE + OUTPUT_ORDER[channel]*2];
+    value |= ((out >> DMA_DAT_SHIFT) & 0x01) << depth;
+  }
+  return value;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Time an encoder, returning the average time per frame in nanoseconds
+static double timeEncoder(void (*encoder)(const Pixel*, uint8_t*), Pixel* input, uint8_t* output) {
+  double start = now();
+  for(int i = 0; i < ITERATIONS; i++) {
+    input[i % LED_COUNT].R = i;
+    encoder(input, output);
+    // Keep the compiler from discarding the work
+    asm volatile("" : : "r"(output) : "memory");
+  }
+  return (now() - start)*1e9/ITERATIONS;
+}
+
+// Time changing a single pixel and re-encoding through setPixel()'s
+// stale channel tracking, returning the average time per frame in nanoseconds
+static double timeSparseUpdate() {
+  double start = now();
+  for(int i = 0; i < ITERATIONS; i++) {
+    setPixel(i % LED_COLS, (i / LED_COLS) % LED_ROWS, i, i >> 1, i >> 2);
+    updateDmaBuffer(pixels, 0);
+    asm volatile("" : : "r"(dmaBuffer[0]) : "memory");
+  }
+  return (now() - start)*1e9/ITERATIONS;
+}
+
+// Time an animation frame that differs from the last in one pixel, copied in
+// with setPixels(), or written through getPixels() (which re-encodes it all)
+static double timeFrameUpdate(bool throughGetPixels) {
+  static Pixel frame[LED_COUNT];
+  double start = now();
+  for(int i = 0; i < ITERATIONS; i++) {
+    frame[i % LED_COUNT].R = i;
+    if(throughGetPixels) {
+      memcpy(getPixels(), frame, sizeof(frame));
+    }
+    else {
+      setPixels(frame);
+    }
+    updateDmaBuffer(pixels, 0);
+    asm volatile("" : : "r"(dmaBuffer[0]) : "memory");
+  }
+  return (now() - start)*1e9/ITERATIONS;
+}
+
+int main() {
+  static Pixel input[LED_COUNT];
+  static uint8_t reference[PANEL_DEPTH_SIZE] __attribute__ ((aligned(4)));
+  static uint8_t output[DMA_BUFFER_SIZE] __attribute__ ((aligned(4)));
+
+  // The reference encoder doesn't dither, or interleave
+  setDithering(false);
+  fillColorTables();
+  fillSchedule();
+
+  srand(1);
+  for(int frame = 0; frame < 1000; frame++) {
+    for(int i = 0; i < LED_COUNT; i++) {
+      input[i].R = rand();
+      input[i].G = rand();
+      input[i].B = rand();
+    }
+
+    referencePixelsToDmaBuffer(input, reference);
+    pixelsToDmaBuffer(input, output);
+
+    if(memcmp(reference, output, PANEL_DEPTH_SIZE) != 0) {
+      printf("Encoder output differs from reference on frame %i\n", frame);
+      return 1;
+    }
+  }
+
+  // The incremental path has to end up with the same waveform as a full encode
+  markAllStale();
+  updateDmaBuffer(pixels, 0);
+  for(int frame = 0; frame < 1000; frame++) {
+    setPixel(rand() % LED_COLS, rand() % LED_ROWS, rand(), rand(), rand());
+    updateDmaBuffer(pixels, 0);
+    referencePixelsToDmaBuffer(pixels, reference);
+
+    if(memcmp(reference, dmaBuffer[0], PANEL_DEPTH_SIZE) != 0) {
+      printf("Incremental output differs from reference on frame %i\n", frame);
+      return 1;
+    }
+  }
+
+  // So does copying in whole frames, that only change in places
+  static Pixel frame[LED_COUNT];
+  memcpy(frame, pixels, sizeof(frame));
+  for(int i = 0; i < 1000; i++) {
+    frame[rand() % LED_COUNT].G = rand();
+    setPixels(frame);
+    updateDmaBuffer(pixels, 0);
+    referencePixelsToDmaBuffer(pixels, reference);
+
+    if(memcmp(reference, dmaBuffer[0], PANEL_DEPTH_SIZE) != 0) {
+      printf("Incremental output differs from reference on frame %i (setPixels)\n", i);
+      return 1;
+    }
+  }
+
+  // With plane interleaving, every slot should hold a copy of its row and
+  // plane from the reference
+  planeInterleaving = true;
+  fillSchedule();
+  for(int frame = 0; frame < 1000; frame++) {
+    for(int i = 0; i < LED_COUNT; i++) {
+      input[i].R = rand();
+      input[i].G = rand();
+      input[i].B = rand();
+    }
+
+    referencePixelsToDmaBuffer(input, reference);
+    pixelsToDmaBuffer(input, output);
+
+    for(int slot = 0; slot < rowSlots*LED_ROWS; slot++) {
+      const uint8_t* plane = reference + slotRows[slot]*ROW_DEPTH_SIZE + slotPlanes[slot]*ROW_BIT_SIZE;
+      if(memcmp(plane, output + slot*ROW_BIT_SIZE, ROW_BIT_SIZE) != 0) {
+        printf("Interleaved output differs from reference on frame %i, slot %i\n", frame, slot);
+        return 1;
+      }
+    }
+  }
+  double interleavedTime = timeEncoder(pixelsToDmaBuffer, input, output);
+  planeInterleaving = false;
+  fillSchedule();
+
+  // With dithering, the average output should track the 16-bit color value.
+  // Alternate between two buffers, as show() and the DMA interrupt would.
+  setDithering(true);
+  for(int i = 0; i < 1000; i++) {
+    uint8_t value = rand();
+    setPixel(0, 0, value, 0, 0);
+
+    const int frames = 256;
+    int sum = 0;
+    for(int frame = 0; frame < frames; frame++) {
+      updateDmaBuffer(pixels, frame & 1);
+      ditherBuffer = frame & 1;
+      sum += decodeChannel(dmaBuffer[frame & 1], 0, 0);
+    }
+
+    double expected = colorTables[0][value]/256.0;
+    if(fabs((double)sum/frames - expected) > 1.0/frames*2) {
+      printf("Dithered output for %i averages %f, expected %f\n", value, (double)sum/frames, expected);
+      return 1;
+    }
+  }
+  setDithering(false);
+
+  double referenceTime = timeEncoder(referencePixelsToDmaBuffer, input, reference);
+  double encoderTime = timeEncoder(pixelsToDmaBuffer, input, output);
+  double sparseTime = timeSparseUpdate();
+  double frameTime = timeFrameUpdate(false);
+  double fullFrameTime = timeFrameUpdate(true);
+
+  printf("pixelsToDmaBuffer, %i iterations\n", ITERATIONS);
+  printf("  reference: %8.1f ns/frame\n", referenceTime);
+  printf("  table:     %8.1f ns/frame\n", encoderTime);
+  printf("  interleaved:%7.1f ns/frame (with copies of the split planes)\n", interleavedTime);
+  printf("  speedup:   %8.2fx\n", referenceTime/encoderTime);
+  printf("  1 pixel:   %8.1f ns/frame (setPixel + updateDmaBuffer)\n", sparseTime);
+  printf("  1 pixel:   %8.1f ns/frame (whole frame, setPixels + updateDmaBuffer)\n", frameTime);
+  printf("  1 pixel:   %8.1f ns/frame (whole frame, getPixels + updateDmaBuffer)\n", fullFrameTime);
+
+  return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * Host benchmark for the POV motion model
+ *
+ * Swings a simulated pendant, with the period and amplitude drifting, and
+ * compares the frame that POV::updatePosition() picks against the frame
+ * that's really at the pendant's position. The dead reckoning model that
+ * the swing model replaced is run alongside, for comparison. Also turns the
+ * swing away from X, to check that the swing axis estimate follows it.
+ *
+ * Note: The host has an FPU, so the timings here don't show what fixed
+ * point saves on the pendant. There, serial command 0x07 reads back the CPU
+ * cycles that the model takes (POV::lastStepCycles and maxStepCycles).
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "matrix.h"
+#include "pov.h"
+#include "mma8653.h"
+#include "animation_data.h"
+
+#define playbackScale 120
+#define ITERATIONS 1000000
+
+extern float hostAcceleration[3];
+extern void readISR();
+
+// The dead reckoning model that the swing model replaced, in floating point
+// as it was first written (including the filter): each stroke starts over
+// from the end of the swing, and integrates the acceleration
+class ReferencePOV {
+private:
+    static const int tapCount = 7;
+    double history[tapCount];
+    unsigned int lastIndex;
+
+    float accX;
+    float velocityX;
+    float posX;
+    int dir;
+    float accXavgLast;
+    int dirLast;
+
+    double filter(double input) {
+        static const double taps[tapCount] = {
+            0.03946073714347548, 0.11838248117085194, 0.2071692727265806, 0.24663000987005582,
+            0.2071692727265806, 0.11838248117085194, 0.03946073714347548
+        };
+
+        history[lastIndex++] = input;
+        if(lastIndex == tapCount) {
+            lastIndex = 0;
+        }
+
+        double acc = 0;
+        int index = lastIndex;
+        for(int i = 0; i < tapCount; ++i) {
+            index = index != 0 ? index - 1 : tapCount - 1;
+            acc += history[index]*taps[i];
+        }
+        return acc;
+    }
+
+public:
+    ReferencePOV() {
+        memset(this, 0, sizeof(*this));
+    }
+
+    void advance(uint32_t ticks) {
+        float delta = ticks*(0.00000417);
+
+        velocityX += (accX)*delta;
+
+        posX += velocityX*delta;
+    }
+
+    // @param sample New acceleration in m/s^2
+    void useSample(float sample, int frameCount) {
+        accX = sample;
+
+        float accXavg = filter(accX);
+        if(accXavg - accXavgLast > 0) {
+            dir = 1;
+        }
+        else if(accXavg - accXavgLast < 0) {
+            dir = -1;
+        }
+        else {
+            dir = dirLast;
+        }
+
+        accXavgLast = accXavg;
+
+        if(dir != dirLast) {
+            velocityX = 0;
+
+            if(dir < 0) {
+                posX = 0;
+            }
+            else {
+                posX = frameCount/playbackScale;
+            }
+        }
+        dirLast = dir;
+    }
+
+    int position() {
+        return posX*playbackScale;
+    }
+};
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// A pendant swinging at about 1.5 Hz, with the rate and the amplitude
+// drifting over a few swings
+class Pendulum {
+public:
+  double phase;             // radians
+  double position;          // m
+  double acceleration;      // m/s^2
+
+  Pendulum() : phase(0) {}
+
+  void step(double t, double dt) {
+    double w = 2*M_PI*(1.5 + 0.2*sin(2*M_PI*t/23));
+    double amplitude = 0.15 + 0.03*sin(2*M_PI*t/17);
+    phase += w*dt;
+    position = -amplitude*cos(phase);
+    acceleration = -w*w*position;
+  }
+
+  bool rising() {
+    return sin(phase) > 0;
+  }
+};
+
+// How well a model lines frames up with where they should be
+struct Accuracy {
+  int steps;                // Steps where a frame should be, or was, showing
+  int close;                // Steps that were off by a frame at most
+  double error[2];          // Sum of errors, on falling and rising strokes (frames)
+  double absoluteError;     // Sum of the size of the errors (frames)
+  int strokeSteps[2];
+
+  Accuracy() {
+    memset(this, 0, sizeof(*this));
+  }
+
+  void add(int frame, int expected, int frameCount, bool rising) {
+    bool shown = frame > -1 && frame < frameCount;
+    bool expectedShown = expected > -1 && expected < frameCount;
+    if(!shown && !expectedShown) {
+      return;
+    }
+
+    steps++;
+    if(shown && abs(frame - expected) <= 1) {
+      close++;
+    }
+    if(shown && expectedShown) {
+      error[rising] += frame - expected;
+      absoluteError += abs(frame - expected);
+      strokeSteps[rising]++;
+    }
+  }
+
+  double closePercent() {
+    return 100.0*close/steps;
+  }
+
+  // Average offset of the rising strokes from the falling ones (frames)
+  double shear() {
+    return error[1]/strokeSteps[1] - error[0]/strokeSteps[0];
+  }
+
+  void print(const char* name) {
+    printf("  %-16s %6.2f%% of steps within a frame, average error %5.2f frames, shear between strokes %5.2f frames\n",
+           name, closePercent(), absoluteError/(strokeSteps[0] + strokeSteps[1]), shear());
+  }
+};
+
+// Run the models for a simulated minute of swinging, with the main loop
+// taking a random time between steps, and now and then falling behind by
+// several samples. Samples go through the real interrupt path, and are
+// quantized like the accelerometer's. The first few seconds, while the
+// models settle, aren't counted.
+// @param angle Turn of the pendant about its hanging (Y) axis, which moves
+//        the swing from X towards Z (degrees). The dead reckoning model
+//        always gets the swing on X.
+static bool compareModels(double angle) {
+  const double tickLength = 0.00000417;     // s
+  const double sampleInterval = 1.0/800;    // s
+  const double settleTime = 5;              // s
+
+  static MMA8653 accelerometer;
+  ReferencePOV reference;
+  Pendulum pendulum;
+  Accuracy swingModel;
+  Accuracy deadReckoning;
+  int predictionErrors = 0;
+
+  pov.setup();
+  pov.setAnimation(&sample_rgb24Animation);
+  int frameCount = sample_rgb24Animation.frameCount;
+
+  srand(1);
+  uint32_t ticks = 0;
+  uint32_t referenceTicks = 0;
+  double nextSample = 0;
+  double t = 0;
+  int steps = 0;
+
+  FTM1_CNT = 0;
+
+  while(ticks*tickLength < 60) {
+    ticks += (rand() % 100 == 0) ? 2000 : 20 + rand() % 200;
+
+    uint32_t sampleTicks;
+    while((sampleTicks = lround(nextSample/tickLength)) <= ticks) {
+      pendulum.step(nextSample, nextSample - t);
+      t = nextSample;
+      nextSample += sampleInterval;
+
+      float acceleration = pendulum.acceleration + (rand() % 100 - 50)*0.02;
+
+      int32_t X, Y, Z;
+      hostAcceleration[0] = acceleration;
+      hostAcceleration[1] = 0;
+      hostAcceleration[2] = 0;
+      accelerometer.getXYZ(X, Y, Z);
+
+      reference.advance(sampleTicks - referenceTicks);
+      referenceTicks = sampleTicks;
+      reference.useSample(X/65536.0, frameCount);
+
+      hostAcceleration[0] = acceleration*cos(angle*M_PI/180);
+      hostAcceleration[1] = (angle != 0) ? 9.8 : 0;
+      hostAcceleration[2] = acceleration*sin(angle*M_PI/180);
+      FTM1_CNT = sampleTicks;
+      readISR();
+    }
+
+    FTM1_CNT = ticks;
+    int frame = pov.updatePosition();
+
+    reference.advance(ticks - referenceTicks);
+    referenceTicks = ticks;
+
+    // Where the pendant really is now
+    double current = ticks*tickLength;
+    pendulum.step(current, current - t);
+    t = current;
+    int expected = floor(frameCount/2.0 + pendulum.position*playbackScale);
+
+    if(current >= settleTime) {
+      swingModel.add(frame, expected, frameCount, pendulum.rising());
+      deadReckoning.add(reference.position(), expected, frameCount, pendulum.rising());
+
+      // The predicted start of the frame should agree with the prediction
+      // of which frame is showing (to within the rounding, 0.1 ms)
+      const uint32_t rounding = 24;
+      uint32_t start;
+      if(frame > -1 && frame < frameCount && pov.frameStart(frame, start)
+         && pov.frameAt(start + rounding) != frame) {
+        predictionErrors++;
+      }
+    }
+    steps++;
+  }
+
+  const int32_t* axis = pov.getSwingAxis();
+  double axisAngle = atan2(axis[2], axis[0])*180/M_PI;
+  double axisLength = sqrt((double)axis[0]*axis[0] + (double)axis[1]*axis[1] + (double)axis[2]*axis[2])
+                      /(1 << POV_AXIS_BITS);
+
+  printf("POV model, swing turned %.0f degrees: %i steps\n", angle, steps);
+  swingModel.print("swing model:");
+  deadReckoning.print("dead reckoning:");
+  printf("  swing axis: %.1f degrees, length %.3f\n", axisAngle, axisLength);
+  printf("  sample ring: up to %u samples waiting, %u overruns\n",
+         pov.samples.maxPending, pov.samples.overruns);
+  printf("  frame start predictions that disagree: %i\n", predictionErrors);
+
+  if(swingModel.closePercent() < 95 || fabs(swingModel.shear()) > 0.5
+     || predictionErrors != 0 || pov.samples.overruns != 0
+     || fabs(axisAngle - angle) > 1 || fabs(axisLength - 1) > 0.01) {
+    printf("Swing model doesn't follow the pendant\n");
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  if(!compareModels(0) || !compareModels(40)) {
+    return 1;
+  }
+
+  static ReferencePOV reference;
+  int frameCount = sample_rgb24Animation.frameCount;
+  uint32_t ticks = 0;
+
+  // Time a step with a new sample each time (the worst case)
+  double start = now();
+  for(int i = 0; i < ITERATIONS; i++) {
+    reference.advance(50);
+    reference.useSample(9.8, frameCount);
+    reference.position();
+    asm volatile("" : : : "memory");
+  }
+  double floatTime = (now() - start)*1e9/ITERATIONS;
+
+  hostAcceleration[0] = 9.8;
+  start = now();
+  for(int i = 0; i < ITERATIONS; i++) {
+    ticks += 50;
+    FTM1_CNT = ticks;
+    readISR();
+    pov.updatePosition();
+  }
+  double fixedTime = (now() - start)*1e9/ITERATIONS;
+
+  printf("Step time, with a new sample (on the host, with an FPU; see command 0x07 for the pendant):\n");
+  printf("  dead reckoning (float): %8.1f ns/step\n", floatTime);
+  printf("  swing model (fixed):    %8.1f ns/step\n", fixedTime);
+
+  return 0;
+}
@@ -0,0 +1,418 @@
+/*
+ * Register-level model of the pendant display hardware, for host builds
+ *
+ * Only what the display driver uses is modelled: eDMA channels with minor
+ * and major linking and scatter/gather, the FTM0 counter with buffered
+ * MOD/C1V registers and a DMA request on the channel 1 match, and the GPIO
+ * pins that drive the LED driver and the row select transistors. FTM1
+ * counts, and interrupts on a channel 0 compare match.
+ *
+ * The write-only DMA command registers (DMA_SERQ, DMA_SSRT and so on) are
+ * reset to NOP after they're handled, so that the simulator can see that the
+ * firmware wrote them. They're handled whenever the firmware has had a chance
+ * to run: at the start of run(), and after calling an interrupt handler.
+ */
+
+#include <sys/mman.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "simulator.h"
+
+// Peripheral windows that the firmware touches
+#define PERIPHERAL_BASE     0x40000000      // Peripheral bridges and GPIO
+#define PERIPHERAL_SIZE     0x00100000
+#define PRIVATE_BASE        0xE0000000      // DWT, NVIC, SysTick and SCB
+#define PRIVATE_SIZE        0x00010000
+
+// LED driver connections
+#define PORTC_DAT_SHIFT     6       // LED driver serial data (Port C)
+#define PORTC_CLK_SHIFT     5       // LED driver clock (Port C)
+#define PORTD_S0_SHIFT      4       // Row 0 select, active low (Port D)
+#define PORTD_STB_SHIFT     6       // LED driver strobe (Port D)
+
+#define FTM_CSC_DMA         0x01    // FTMx_CnSC: DMA request on channel match
+#define FTM_CSC_CHIE        0x40    // FTMx_CnSC: Channel interrupt (or DMA request) enable
+#define FTM_CSC_CHF         0x80    // FTMx_CnSC: Channel match flag
+#define FTM_CSC_MODE        0x30    // FTMx_CnSC: Mode select bits (MSB:MSA)
+#define FTM_CSC_MSA         0x10    // FTMx_CnSC: Output compare mode
+
+// Estimated eDMA timing, in system clocks, for checking that the transfers
+// fit in the blanking time between OE pulses
+#define DMA_MINOR_LOOP_CYCLES   7   // Arbitration and TCD read/writeback, per minor loop
+#define DMA_TRANSFER_CYCLES     2   // Read and write, per transfer
+
+// Driver output that each color channel is wired to on the pendant. This is
+// the board layout that OUTPUT_ORDER in matrix.cpp was written for: a bit
+// shifted out at position n ends up on output 14 - n.
+const uint8_t BOARD_WIRING[SIM_CHANNELS] = {
+    12, 14, 13,     // R0 G0 B0
+     9, 11, 10,     // R1 G1 B1
+     6,  8,  7,     // R2 G2 B2
+     3,  5,  4,     // R3 G3 B3
+     0,  2,  1,     // R4 G4 B4
+};
+
+// Layout of the DMA_TCDn registers
+struct SimTCD {
+    uint32_t SADDR;
+    int16_t SOFF;
+    uint16_t ATTR;
+    uint32_t NBYTES;
+    int32_t SLAST;
+    uint32_t DADDR;
+    int16_t DOFF;
+    uint16_t CITER;
+    int32_t DLASTSGA;
+    uint16_t CSR;
+    uint16_t BITER;
+};
+
+#define SIM_TCD(n) ((volatile SimTCD*)&DMA_TCD0_SADDR + (n))
+
+#define CITER_LINKCH(citer)     (((citer) >> 9) & 0x0F)
+#define CSR_MAJORLINKCH(csr)    (((csr) >> 8) & 0x0F)
+
+DisplaySimulator simulator;
+
+// Back the register windows with memory before any firmware code runs. The
+// host build has to be position dependent, so that the TCDs can hold
+// pointers to the firmware's buffers in 32 bits.
+static void mapWindow(uintptr_t base, size_t size) {
+    void* window = mmap((void*)base, size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if(window != (void*)base) {
+        fprintf(stderr, "Couldn't map registers at 0x%08lx\n", (unsigned long)base);
+        exit(1);
+    }
+}
+
+__attribute__((constructor)) static void mapRegisters() {
+    mapWindow(PERIPHERAL_BASE, PERIPHERAL_SIZE);
+    mapWindow(PRIVATE_BASE, PRIVATE_SIZE);
+
+    simulator.reset();
+}
+
+void DisplaySimulator::reset() {
+    memset((void*)PERIPHERAL_BASE, 0, PERIPHERAL_SIZE);
+    memset((void*)PRIVATE_BASE, 0, PRIVATE_SIZE);
+
+    DMA_CERQ = DMA_CERQ_NOP;
+    DMA_SERQ = DMA_SERQ_NOP;
+    DMA_CDNE = DMA_CDNE_NOP;
+    DMA_SSRT = DMA_SSRT_NOP;
+    DMA_CINT = DMA_CINT_NOP;
+
+    shiftRegister = 0;
+    outputLatch = 0;
+    portC = 0;
+    portD = 0;
+
+    counter = 0;
+    mod = 0;
+    c1v = 0;
+    matched = false;
+
+    erq = 0;
+    busCycles = 0;
+    pendingInterrupts = 0;
+    ftm1Clocks = 0;
+
+    refreshes = 0;
+    refreshTicks = 0;
+    refreshStart = hostTicks;
+    periods = 0;
+    overruns = 0;
+    ghostPeriods = 0;
+    interrupts = 0;
+
+    clearCounts();
+}
+
+void DisplaySimulator::clearCounts() {
+    memset(onTicks, 0, sizeof(onTicks));
+}
+
+void DisplaySimulator::run(uint32_t ticks) {
+    processCommands();
+
+    while(ticks > 0) {
+        ticks -= step(ticks);
+    }
+}
+
+void DisplaySimulator::runRefresh() {
+    processCommands();
+
+    uint32_t target = refreshes + 1;
+    while(refreshes != target) {
+        step(0xFFFFFFFF);
+    }
+}
+
+// Run FTM0 up to the next event (the channel 1 match, or the end of the
+// period), or for maxTicks, whichever comes first.
+// @return Number of ticks that were run
+uint32_t DisplaySimulator::step(uint32_t maxTicks) {
+    // The counter only runs once FTM0 has a clock source
+    if((FTM0_SC & FTM_SC_CLKS(3)) == 0) {
+        advanceTime(maxTicks);
+        return maxTicks;
+    }
+
+    if(!matched && c1v <= mod && counter >= c1v) {
+        matched = true;
+        timerMatch();
+        return 0;
+    }
+
+    uint32_t end = (!matched && c1v <= mod) ? c1v : mod + 1;
+    uint32_t ticks = end - counter;
+    if(ticks > maxTicks) {
+        ticks = maxTicks;
+    }
+
+    // The OE output is low (LEDs on) from the start of the period until the
+    // match. If C1V is past the end of the period, it never turns off.
+    if(counter < c1v) {
+        accumulate(ticks);
+    }
+
+    counter += ticks;
+    advanceTime(ticks);
+
+    if(counter == mod + 1) {
+        // MOD and C1V writes take effect when the counter wraps
+        counter = 0;
+        mod = FTM0_MOD;
+        c1v = FTM0_C1V;
+        matched = false;
+        periods++;
+    }
+
+    return ticks;
+}
+
+// Move the clocks along, including FTM1 (which the POV code uses as a timer)
+void DisplaySimulator::advanceTime(uint32_t ticks) {
+    hostTicks += ticks;
+    systick_millis_count = hostTicks/(SIM_TICK_RATE/1000);
+
+    if(FTM1_SC & FTM_SC_CLKS(3)) {
+        uint32_t prescale = 1 << (FTM1_SC & 0x07);
+
+        ftm1Clocks += ticks*(F_BUS/SIM_TICK_RATE);
+        uint32_t counts = ftm1Clocks/prescale;
+        uint32_t from = FTM1_CNT;
+        FTM1_CNT = (from + counts) % (FTM1_MOD + 1);
+        ftm1Clocks %= prescale;
+
+        // Channel 0 output compare: the match happens when the counter
+        // reaches C0V, so look for it among the counts just run
+        if((FTM1_C0SC & FTM_CSC_MODE) == FTM_CSC_MSA
+           && ((FTM1_C0V - from - 1) & FTM1_MOD) < counts) {
+            FTM1_C0SC |= FTM_CSC_CHF;
+            if(FTM1_C0SC & FTM_CSC_CHIE) {
+                ftm1_isr();
+                processCommands();
+            }
+        }
+    }
+}
+
+void DisplaySimulator::processCommands() {
+    if(DMA_CERQ != DMA_CERQ_NOP) {
+        erq &= (DMA_CERQ & DMA_CERQ_CAER) ? 0 : ~(1 << (DMA_CERQ & 0x0F));
+        DMA_CERQ = DMA_CERQ_NOP;
+    }
+
+    if(DMA_SERQ != DMA_SERQ_NOP) {
+        erq |= (DMA_SERQ & DMA_SERQ_SAER) ? 0xFFFF : (1 << (DMA_SERQ & 0x0F));
+        DMA_SERQ = DMA_SERQ_NOP;
+    }
+    DMA_ERQ = erq;
+
+    if(DMA_CDNE != DMA_CDNE_NOP) {
+        SIM_TCD(DMA_CDNE & 0x0F)->CSR &= ~DMA_TCD_CSR_DONE;
+        DMA_CDNE = DMA_CDNE_NOP;
+    }
+
+    if(DMA_CINT != DMA_CINT_NOP) {
+        DMA_INT &= ~(1 << (DMA_CINT & 0x0F));
+        DMA_CINT = DMA_CINT_NOP;
+    }
+
+    if(DMA_SSRT != DMA_SSRT_NOP) {
+        int channel = DMA_SSRT & 0x0F;
+        DMA_SSRT = DMA_SSRT_NOP;
+        startChannel(channel);
+    }
+}
+
+// Run a channel, and any channels that it links to
+void DisplaySimulator::startChannel(int channel) {
+    while(channel >= 0) {
+        channel = serviceChannel(channel);
+    }
+
+    // Let the firmware handle any interrupts that were raised
+    if(pendingInterrupts & (1 << 3)) {
+        pendingInterrupts &= ~(1 << 3);
+        interrupts++;
+        dma_ch3_isr();
+        processCommands();
+    }
+}
+
+// Run one minor loop of a channel
+// @return Channel to start next (through a minor or major link), or -1
+int DisplaySimulator::serviceChannel(int channel) {
+    volatile SimTCD* tcd = SIM_TCD(channel);
+
+    int sourceSize = 1 << ((tcd->ATTR >> 8) & 0x07);
+    int destinationSize = 1 << (tcd->ATTR & 0x07);
+
+    uint32_t source = tcd->SADDR;
+    uint32_t destination = tcd->DADDR;
+
+    busCycles += DMA_MINOR_LOOP_CYCLES;
+    for(uint32_t count = 0; count < tcd->NBYTES; count += destinationSize) {
+        uint32_t value = readBus(source, sourceSize);
+        writeBus(destination, value, destinationSize);
+
+        source += tcd->SOFF;
+        destination += tcd->DOFF;
+        busCycles += DMA_TRANSFER_CYCLES;
+    }
+
+    tcd->SADDR = source;
+    tcd->DADDR = destination;
+
+    uint16_t citer = tcd->CITER;
+    bool elink = citer & DMA_TCD_CITER_ELINK;
+    uint16_t countMask = elink ? 0x01FF : 0x7FFF;
+    uint16_t count = (citer & countMask) - 1;
+
+    if(count > 0) {
+        tcd->CITER = (citer & ~countMask) | count;
+        return elink ? CITER_LINKCH(citer) : -1;
+    }
+
+    // End of the major loop. The minor link isn't made on the last minor
+    // loop; the major link is used instead.
+    tcd->SADDR = source + tcd->SLAST;
+
+    uint16_t csr = tcd->CSR;
+    if(csr & DMA_TCD_CSR_INTMAJOR) {
+        DMA_INT |= 1 << channel;
+        pendingInterrupts |= 1 << channel;
+    }
+
+    if(csr & DMA_TCD_CSR_ESG) {
+        // Scatter/gather: load the next TCD from memory
+        const SimTCD* next = (const SimTCD*)(uintptr_t)(uint32_t)tcd->DLASTSGA;
+        tcd->SADDR = next->SADDR;
+        tcd->SOFF = next->SOFF;
+        tcd->ATTR = next->ATTR;
+        tcd->NBYTES = next->NBYTES;
+        tcd->SLAST = next->SLAST;
+        tcd->DADDR = next->DADDR;
+        tcd->DOFF = next->DOFF;
+        tcd->CITER = next->CITER;
+        tcd->DLASTSGA = next->DLASTSGA;
+        tcd->BITER = next->BITER;
+        tcd->CSR = next->CSR;
+    }
+    else {
+        tcd->DADDR = destination + tcd->DLASTSGA;
+        tcd->CITER = tcd->BITER;
+        tcd->CSR = csr | DMA_TCD_CSR_DONE;
+    }
+
+    // The timer channel loads the last slot's timing once per refresh
+    if(channel == 0) {
+        refreshes++;
+        refreshTicks = hostTicks - refreshStart;
+        refreshStart = hostTicks;
+    }
+
+    return (csr & DMA_TCD_CSR_MAJORELINK) ? CSR_MAJORLINKCH(csr) : -1;
+}
+
+uint32_t DisplaySimulator::readBus(uint32_t address, int size) {
+    switch(size) {
+        case 1: return *(volatile uint8_t*)(uintptr_t)address;
+        case 2: return *(volatile uint16_t*)(uintptr_t)address;
+        default: return *(volatile uint32_t*)(uintptr_t)address;
+    }
+}
+
+void DisplaySimulator::writeBus(uint32_t address, uint32_t value, int size) {
+    switch(size) {
+        case 1: *(volatile uint8_t*)(uintptr_t)address = value; break;
+        case 2: *(volatile uint16_t*)(uintptr_t)address = value; break;
+        default: *(volatile uint32_t*)(uintptr_t)address = value; break;
+    }
+
+    if(address == (uint32_t)(uintptr_t)&GPIOC_PDOR) {
+        // The driver shifts in a data bit on each rising clock edge
+        if(!(portC & (1 << PORTC_CLK_SHIFT)) && (value & (1 << PORTC_CLK_SHIFT))) {
+            shiftRegister = (shiftRegister << 1) | ((value >> PORTC_DAT_SHIFT) & 0x01);
+        }
+        portC = value;
+    }
+    else if(address == (uint32_t)(uintptr_t)&GPIOD_PDOR) {
+        // and copies them to its outputs on the strobe
+        if(!(portD & (1 << PORTD_STB_SHIFT)) && (value & (1 << PORTD_STB_SHIFT))) {
+            outputLatch = shiftRegister;
+        }
+        portD = value;
+    }
+}
+
+void DisplaySimulator::timerMatch() {
+    bool request = (FTM0_C1SC & (FTM_CSC_DMA | FTM_CSC_CHIE)) == (FTM_CSC_DMA | FTM_CSC_CHIE)
+                && DMAMUX0_CHCFG0 == (DMAMUX_SOURCE_FTM0_CH1 | DMAMUX_ENABLE)
+                && (erq & 0x01);
+
+    if(!request) {
+        return;
+    }
+
+    busCycles = 0;
+    startChannel(0);
+
+    // The next OE pulse starts when the counter wraps; the address and data
+    // have to be out by then.
+    uint32_t dmaTicks = (uint64_t)busCycles*SIM_TICK_RATE/F_CPU;
+    if(counter + dmaTicks > mod + 1) {
+        overruns++;
+    }
+}
+
+void DisplaySimulator::accumulate(uint32_t ticks) {
+    if(outputLatch == 0) {
+        return;
+    }
+
+    int selected = -1;
+    int selectedCount = 0;
+    for(int row = 0; row < LED_ROWS; row++) {
+        if(!(portD & (1 << (PORTD_S0_SHIFT + row)))) {
+            selected = row;
+            selectedCount++;
+        }
+    }
+
+    if(selectedCount != 1) {
+        ghostPeriods++;
+        return;
+    }
+
+    for(int channel = 0; channel < SIM_CHANNELS; channel++) {
+        if(outputLatch & (1 << BOARD_WIRING[channel])) {
+            onTicks[selected][channel] += ticks;
+        }
+    }
+}
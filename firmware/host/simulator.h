@@ -0,0 +1,82 @@
+/*
+ * Register-level model of the pendant display hardware, for host builds
+ *
+ * The firmware's peripheral registers are backed by plain memory, mapped at
+ * their real addresses, so that matrix.cpp and friends can be compiled and
+ * run unchanged. The simulator then plays the part of the eDMA engine, FTM0
+ * and the GPIO ports: it follows the TCDs the firmware set up, and decodes
+ * the GPIOC_PDOR (data/clock) and GPIOD_PDOR (address/strobe) writes through
+ * a model of the LED driver shift register back into per-LED on time.
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <stdint.h>
+#include "matrix.h"
+
+#define SIM_CHANNELS (LED_COLS*BYTES_PER_PIXEL)     // LED driver outputs in use, one per color channel
+
+// Simulated time, shared with the micros()/millis() stand-ins
+extern uint64_t hostTicks;                          // FTM0 ticks since startup
+
+// Clock rate of the simulated FTM0 counter
+#define SIM_TICK_RATE (F_BUS/2)
+
+class DisplaySimulator {
+public:
+    // Accumulated time that each LED was on, in FTM0 ticks
+    uint32_t onTicks[LED_ROWS][SIM_CHANNELS];
+
+    uint32_t refreshes;         // Number of completed refreshes (FTM0_MOD table reloads)
+    uint32_t refreshTicks;      // Length of the last complete refresh, in FTM0 ticks
+    uint32_t periods;           // Number of FTM0 periods run
+    uint32_t overruns;          // Periods where the DMA transfers (probably) didn't fit in the blanking time
+    uint32_t ghostPeriods;      // Periods where the outputs were on with no row, or more than one, selected
+    uint32_t interrupts;        // Pixel data DMA interrupts delivered to the firmware
+
+    // Start over with the state of the hardware after reset
+    void reset();
+
+    // Clear the accumulated on times
+    void clearCounts();
+
+    // Run the display hardware for a number of FTM0 ticks
+    void run(uint32_t ticks);
+
+    // Run the display hardware until the end of the next refresh
+    void runRefresh();
+
+private:
+    uint16_t shiftRegister;     // LED driver shift register contents
+    uint16_t outputLatch;       // LED driver output latch
+    uint32_t portC;             // Last value written to GPIOC_PDOR
+    uint32_t portD;             // Last value written to GPIOD_PDOR
+
+    uint32_t counter;           // FTM0 counter
+    uint32_t mod;               // FTM0_MOD, as loaded at the start of the period
+    uint32_t c1v;               // FTM0_C1V, as loaded at the start of the period
+    bool matched;               // True once the channel 1 match has happened in this period
+
+    uint32_t erq;               // DMA channels with hardware requests enabled
+    uint32_t busCycles;         // Estimated DMA bus cycles used since the last timer match
+    uint32_t pendingInterrupts; // DMA channels with an interrupt to deliver
+
+    uint64_t refreshStart;      // Time that the current refresh started, in FTM0 ticks
+    uint32_t ftm1Clocks;        // Bus clocks towards the next FTM1 count
+
+    void advanceTime(uint32_t ticks);
+    uint32_t step(uint32_t maxTicks);
+    void processCommands();
+    void startChannel(int channel);
+    int serviceChannel(int channel);
+    void writeBus(uint32_t address, uint32_t value, int size);
+    uint32_t readBus(uint32_t address, int size);
+
+    void timerMatch();
+    void accumulate(uint32_t ticks);
+};
+
+extern DisplaySimulator simulator;
+
+#endif
@@ -0,0 +1,553 @@
+/*
+ * Waveform check for the DMA matrix driver
+ *
+ * Runs the real display code against the register-level simulator, and
+ * checks that the decoded on time of every LED matches the colors that were
+ * shown, for each bit depth and display mode, upside down, and for frames
+ * encoded straight from flash, and that the display only interrupts the CPU
+ * when there's a new frame. Also reports the refresh rate that comes out
+ * of the waveform, the frame latency, and what a swinging pendant does to
+ * the POV code: frames should go up on time, whether the main loop is quick
+ * or slow, and the pendant should look still once it stops swinging, and
+ * wake up again without hanging.
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include "matrix.h"
+#include "pov.h"
+#include "mma8653.h"
+#include "simulator.h"
+#include "animation_data.h"
+
+#define LOW_BIT_ENABLE_TIME 0x10    // On time of the least significant bit plane (see fillTimerStates())
+
+extern Pixel pixels[];
+extern uint16_t colorTables[][256];
+extern float hostAcceleration[3];
+extern void readISR();
+extern void hostMotion();
+extern MMA8653 mma8653;
+
+static void randomPixels() {
+  for(int row = 0; row < LED_ROWS; row++) {
+    for(int col = 0; col < LED_COLS; col++) {
+      setPixel(col, row, rand(), rand(), rand());
+    }
+  }
+}
+
+// Value that a channel should be displayed at, in bit planes of the current depth
+static double expectedValue(int row, int channel) {
+  const uint8_t* channels = (const uint8_t*)pixels;
+  if(getFlipped()) {
+    row = LED_ROWS - 1 - row;
+    channel = (LED_COLS - 1 - channel/BYTES_PER_PIXEL)*BYTES_PER_PIXEL + channel % BYTES_PER_PIXEL;
+  }
+  uint16_t value = colorTables[channel % BYTES_PER_PIXEL][channels[row*LED_COLS*BYTES_PER_PIXEL + channel]];
+  return value/(double)(1 << (16 - getBitDepth()));
+}
+
+// Run the display until the last frame has gone out completely
+static void settle() {
+  while(bufferWaiting()) {
+    simulator.runRefresh();
+  }
+  simulator.runRefresh();
+}
+
+// Run a few refreshes, and check the on time of every LED against the pixels
+// (without dithering)
+// @return Number of LEDs that were wrong
+static int countWrongLeds() {
+  const int refreshes = 4;
+
+  simulator.clearCounts();
+  simulator.overruns = 0;
+  simulator.ghostPeriods = 0;
+  for(int i = 0; i < refreshes; i++) {
+    simulator.runRefresh();
+  }
+
+  int errors = 0;
+  for(int row = 0; row < LED_ROWS; row++) {
+    for(int channel = 0; channel < SIM_CHANNELS; channel++) {
+      uint32_t expected = (uint32_t)expectedValue(row, channel)*LOW_BIT_ENABLE_TIME*refreshes;
+      if(simulator.onTicks[row][channel] != expected) {
+        errors++;
+      }
+    }
+  }
+  return errors;
+}
+
+// Show a random frame, and check the on time of every LED over a few refreshes
+static bool checkWaveform(int depth, bool interleaving, bool rowSync) {
+  setBitDepth(depth);
+  setPlaneInterleaving(interleaving);
+  setRowSync(rowSync);
+  setDithering(false);
+
+  randomPixels();
+  show();
+  settle();
+
+  int errors = countWrongLeds();
+
+  uint32_t measured = SIM_TICK_RATE/simulator.refreshTicks;
+  bool pass = (errors == 0) && (simulator.overruns == 0) && (simulator.ghostPeriods == 0)
+              && (measured == getRefreshRate());
+
+  printf("  %i bit, %-11s %-10s %6u Hz (expected %6u Hz)  %s",
+         depth, interleaving ? "interleaved" : "sequential", rowSync ? "row sync" : "frame sync",
+         measured, getRefreshRate(), pass ? "ok" : "FAILED");
+  if(!pass) {
+    printf(" (%i LEDs wrong, %u overruns, %u ghost periods)",
+           errors, simulator.overruns, simulator.ghostPeriods);
+  }
+  printf("\n");
+
+  return pass;
+}
+
+// The display should only interrupt the CPU while a new frame is waiting to
+// go out: a couple of times for each frame, and never while it's idle
+static bool checkInterrupts(int depth, bool rowSync) {
+  const int refreshes = 16;
+
+  setBitDepth(depth);
+  setPlaneInterleaving(true);
+  setRowSync(rowSync);
+  setDithering(false);
+
+  randomPixels();
+  show();
+  settle();
+
+  simulator.interrupts = 0;
+  for(int i = 0; i < refreshes; i++) {
+    simulator.runRefresh();
+  }
+  uint32_t idle = simulator.interrupts;
+
+  simulator.interrupts = 0;
+  randomPixels();
+  show();
+  settle();
+  uint32_t frame = simulator.interrupts;
+
+  bool pass = (idle == 0) && (frame > 0) && (frame <= 2);
+  printf("  %i bit, %-10s %u while idle for %i refreshes, %u for a new frame  %s\n",
+         depth, rowSync ? "row sync" : "frame sync", idle, refreshes, frame, pass ? "ok" : "FAILED");
+  return pass;
+}
+
+// Show the same frame over and over, and check that the dithered on time
+// averages out to the full resolution color
+static bool checkDithering(int depth) {
+  const int refreshes = 1024;
+
+  setBitDepth(depth);
+  setPlaneInterleaving(true);
+  setRowSync(true);
+  setDithering(true);
+
+  randomPixels();
+  show();
+  settle();
+
+  simulator.clearCounts();
+  for(int i = 0; i < refreshes; i++) {
+    if(!bufferWaiting()) {
+      show();
+    }
+    simulator.runRefresh();
+  }
+
+  // Anything over the top level can't be shown, and is clipped to it
+  const double maxValue = (1 << depth) - 1;
+
+  double worst = 0;
+  for(int row = 0; row < LED_ROWS; row++) {
+    for(int channel = 0; channel < SIM_CHANNELS; channel++) {
+      double average = simulator.onTicks[row][channel]/(double)(LOW_BIT_ENABLE_TIME*refreshes);
+      double error = fabs(average - fmin(expectedValue(row, channel), maxValue));
+      if(error > worst) {
+        worst = error;
+      }
+    }
+  }
+
+  bool pass = worst < 0.05;
+  printf("  %i bit, dithered: worst average error %.4f LSB  %s\n", depth, worst, pass ? "ok" : "FAILED");
+  return pass;
+}
+
+// Cache a frame, show a different one, and then bring the cached one back
+// without the pixels. It should look the same as it did the first time.
+static bool checkFrameCache() {
+  static Pixel cached[LED_COUNT];
+
+  setBitDepth(POV_BIT_DEPTH);
+  setPlaneInterleaving(true);
+  setRowSync(true);
+  setDithering(false);
+  clearFrameCache();
+
+  randomPixels();
+  memcpy(cached, pixels, sizeof(cached));
+  prepareAndCache(1);
+  present();
+  settle();
+  int errors = countWrongLeds();
+
+  randomPixels();
+  show();
+  settle();
+
+  bool hit = prepareCached(1);
+  present();
+  settle();
+  memcpy(pixels, cached, sizeof(cached));
+  errors += countWrongLeds();
+
+  bool pass = hit && (errors == 0);
+  printf("  cached frame shown again: %s", pass ? "ok" : "FAILED");
+  if(!pass) {
+    printf(" (%s, %i LEDs wrong)", hit ? "hit" : "missed", errors);
+  }
+  printf("\n");
+
+  // The pixels were put back behind show()'s back
+  getPixels();
+  return pass;
+}
+
+// Put a frame up straight from the animation data, then show the pixels
+// again: the buffer prepareFrom() used has to be encoded in full next time
+static bool checkDirectFrame() {
+  static Pixel saved[LED_COUNT];
+  const Pixel* frame = (const Pixel*)sample_rgb24Animation.getFrame(20);
+
+  setBitDepth(POV_BIT_DEPTH);
+  setPlaneInterleaving(true);
+  setRowSync(true);
+  setDithering(false);
+
+  randomPixels();
+  show();
+  settle();
+  memcpy(saved, pixels, sizeof(saved));
+
+  int errors = 0;
+  for(int i = 0; i < 3; i++) {
+    prepareFrom(frame);
+    present();
+    settle();
+    memcpy(pixels, frame, sizeof(saved));
+    errors += countWrongLeds();
+    memcpy(pixels, saved, sizeof(saved));
+
+    // Nothing changed in the pixels, so only the staleness marks make this
+    // re-encode whichever buffer it lands in
+    show();
+    settle();
+    errors += countWrongLeds();
+  }
+
+  bool pass = (errors == 0);
+  printf("  frame from flash, then the pixels: %s", pass ? "ok" : "FAILED");
+  if(!pass) {
+    printf(" (%i LEDs wrong)", errors);
+  }
+  printf("\n");
+  return pass;
+}
+
+// Swing the pendant back and forth, and run the POV mode main loop, taking a
+// random time for each pass. Frames should go up when the model says they're
+// due, however long the loop takes, as long as it gets round in time to
+// prepare each one.
+// @param loopTicks Longest main loop pass (FTM0 ticks)
+static bool runPov(uint32_t loopTicks) {
+  const double swingRate = 1.5;                 // Swings per second
+  const double swingAcceleration = 13;          // m/s^2, about 15cm each way
+  const double seconds = 4;
+  const double settleTime = 2;                  // s, for the model to lock on
+  const uint32_t sampleTicks = SIM_TICK_RATE/800; // Accelerometer sample rate
+
+  setBitDepth(POV_BIT_DEPTH);
+  setPlaneInterleaving(true);
+  setRowSync(true);
+
+  pov.setup();
+  pov.setAnimation(&sample_rgb24Animation);
+
+  DisplayStats before;
+  clearFrameCacheStats();
+
+  uint64_t start = hostTicks;
+  uint64_t nextSample = hostTicks;
+  bool settled = false;
+  while(hostTicks - start < seconds*SIM_TICK_RATE) {
+    if(!settled && hostTicks - start >= settleTime*SIM_TICK_RATE) {
+      settled = true;
+      pov.clearJitter();
+      clearFrameCacheStats();
+      before = getDisplayStats();
+    }
+
+    while(hostTicks >= nextSample) {
+      double t = (nextSample - start)/(double)SIM_TICK_RATE;
+      hostAcceleration[0] = swingAcceleration*cos(2*M_PI*swingRate*t);
+      readISR();
+      nextSample += sampleTicks;
+    }
+
+    pov.computeStep();
+    simulator.run(loopTicks/4 + rand() % (loopTicks*3/4));
+  }
+
+  DisplayStats after = getDisplayStats();
+  uint32_t timed = 0;
+  uint32_t late = 0;
+  for(int bin = 0; bin < POV_JITTER_BINS; bin++) {
+    timed += pov.jitterHistogram[bin];
+    if(bin > 1) {
+      late += pov.jitterHistogram[bin];
+    }
+  }
+
+  printf("  loop up to %4u us: %u frames presented, %u dropped, %u on the timer, %u from the loop, latency up to %u us\n",
+         loopTicks/(SIM_TICK_RATE/1000000), after.framesPresented - before.framesPresented,
+         after.framesDropped - before.framesDropped, timed, pov.missedFrames, after.maxLatency);
+  FrameCacheStats cache = getFrameCacheStats();
+  printf("    frame cache: %u hits, %u misses (%.0f%%)\n",
+         cache.hits, cache.misses, 100.0*cache.hits/(cache.hits + cache.misses));
+  printf("    lateness (FTM1 ticks):");
+  for(int bin = 0; bin < POV_JITTER_BINS; bin++) {
+    if(bin == 0) {
+      printf("  0: %u", pov.jitterHistogram[bin]);
+    }
+    else if(bin == POV_JITTER_BINS - 1) {
+      printf("  %i+: %u", 1 << (bin - 1), pov.jitterHistogram[bin]);
+    }
+    else {
+      printf("  %i-%i: %u", 1 << (bin - 1), (1 << bin) - 1, pov.jitterHistogram[bin]);
+    }
+  }
+  printf("\n");
+
+  // The timer can be a tick late, from the simulator's step size
+  bool pass = (timed > 0) && (late == 0) && (pov.missedFrames*20 < timed);
+  if(!pass) {
+    printf("    Frames weren't put up on time\n");
+  }
+  return pass;
+}
+
+// Swing the pendant, and then hang it still. The power manager should see
+// the swing as motion, and the pendant as still soon after it stops.
+static bool checkStillness() {
+  const double swingTime = 2;                   // s
+  const double stillTime = 3;                   // s
+  const uint32_t sampleTicks = SIM_TICK_RATE/800;
+
+  pov.setup();
+  pov.setAnimation(&sample_rgb24Animation);
+
+  uint64_t start = hostTicks;
+  uint32_t swinging = 0;
+  while(hostTicks - start < (swingTime + stillTime)*SIM_TICK_RATE) {
+    double t = (hostTicks - start)/(double)SIM_TICK_RATE;
+    hostAcceleration[0] = (t < swingTime) ? 13*cos(2*M_PI*1.5*t) : 0;
+    hostAcceleration[1] = 9.8;
+    readISR();
+    pov.updatePosition();
+    simulator.run(sampleTicks);
+
+    if(t >= 1 && t < swingTime && pov.stillTime() > swinging) {
+      swinging = pov.stillTime();
+    }
+  }
+  hostAcceleration[1] = 0;
+
+  uint32_t still = pov.stillTime();
+  bool pass = (swinging < 100) && (still > (stillTime - 1)*1000);
+  printf("  still for up to %u ms while swinging, %u ms after %.0f s hanging still  %s\n",
+         swinging, still, stillTime, pass ? "ok" : "FAILED");
+  return pass;
+}
+
+// Wake the pendant with the motion event that woke it still holding the
+// interrupt pin low. Until it's let go, the sample and orientation reads
+// keep starting each other, so wake() can't wait for them to finish.
+// Samples should come in afterwards.
+static bool checkWake() {
+  pov.setup();
+  pov.setAnimation(&sample_rgb24Animation);
+  pov.sleep();
+
+  hostAcceleration[1] = 9.8;
+  hostMotion();
+  readISR();                    // The motion interrupt starts a read
+  pov.wake();
+
+  bool released = digitalReadFast(ACCELEROMETER_INT) == HIGH;
+  bool idle = !mma8653.busy();
+
+  readISR();
+  AccelerometerSample sample;
+  bool sampled = pov.samples.get(sample);
+  hostAcceleration[1] = 0;
+
+  bool pass = released && idle && sampled;
+  printf("  wake with the interrupt pin held low: pin %s, reads %s, samples %s  %s\n",
+         released ? "released" : "still low", idle ? "stopped" : "still running",
+         sampled ? "coming in" : "missing", pass ? "ok" : "FAILED");
+  return pass;
+}
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+// Host time for show() with one pixel changed (the display isn't running,
+// so every frame gets encoded)
+static void timeShow() {
+  const int iterations = 1000000;
+
+  setBitDepth(MAX_BIT_DEPTH);
+  setPlaneInterleaving(false);
+  setDithering(false);
+  setTripleBuffering(true);
+
+  double start = now();
+  for(int i = 0; i < iterations; i++) {
+    setPixel(i % LED_COLS, (i / LED_COLS) % LED_ROWS, i, i >> 1, i >> 2);
+    show();
+  }
+  printf("  show(): %.1f ns per frame (1 pixel changed)\n", (now() - start)*1e9/iterations);
+}
+
+// Host time to get a POV column ready: setting the pixels and encoding them,
+// against handing over a cached frame
+static void timeColumn() {
+  const int iterations = 1000000;
+  const uint8_t* frame = sample_rgb24Animation.getFrame(0);
+
+  setBitDepth(POV_BIT_DEPTH);
+  setPlaneInterleaving(true);
+  setDithering(false);
+  clearFrameCache();
+
+  double start = now();
+  for(int i = 0; i < iterations; i++) {
+    for(int pixel = 0; pixel < LED_COUNT; pixel++) {
+      const uint8_t* color = frame + ((pixel + i) % LED_COUNT)*3;
+      setPixel(pixel % LED_COLS, pixel / LED_COLS, color[0], color[1], color[2]);
+    }
+    prepare();
+  }
+  double encodeTime = (now() - start)*1e9/iterations;
+
+  prepareAndCache(0);
+  start = now();
+  for(int i = 0; i < iterations; i++) {
+    prepareCached(0);
+  }
+  double cacheTime = (now() - start)*1e9/iterations;
+
+  // A cache miss in POV mode, decoding the frame into the pixels and
+  // encoding it from there, against encoding it straight from flash
+  Animation* animation = &sample_rgb24Animation;
+  start = now();
+  for(int i = 0; i < iterations; i++) {
+    animation->drawFrame(i % animation->frameCount, getPixels());
+    prepareAndCache(i);
+  }
+  double pixelsTime = (now() - start)*1e9/iterations;
+
+  static Pixel buffer[LED_COUNT];
+  start = now();
+  for(int i = 0; i < iterations; i++) {
+    prepareAndCacheFrom(i, animation->getFramePixels(i % animation->frameCount, buffer));
+  }
+  double directTime = (now() - start)*1e9/iterations;
+
+  // The part that goes: getting the frame ready to encode
+  start = now();
+  for(int i = 0; i < iterations; i++) {
+    animation->drawFrame(i % animation->frameCount, getPixels());
+  }
+  double stagedTime = (now() - start)*1e9/iterations;
+
+  const Pixel* volatile direct;
+  start = now();
+  for(int i = 0; i < iterations; i++) {
+    direct = animation->getFramePixels(i % animation->frameCount, buffer);
+  }
+  (void)direct;
+  double pointerTime = (now() - start)*1e9/iterations;
+
+  printf("  POV column: %.1f ns encoded, %.1f ns from the cache\n", encodeTime, cacheTime);
+  printf("  POV cache miss: %.1f ns through the pixels, %.1f ns straight from flash\n",
+         pixelsTime, directTime);
+  printf("    (of which staging the frame: %.1f ns copied to the pixels, %.1f ns pointed at)\n",
+         stagedTime, pointerTime);
+}
+
+int main() {
+  bool pass = true;
+
+  matrixSetup();
+  setTripleBuffering(true);
+
+  srand(1);
+
+  printf("Waveform:\n");
+  const int depths[] = {MAX_BIT_DEPTH, POV_BIT_DEPTH, 1};
+  for(unsigned int i = 0; i < sizeof(depths)/sizeof(depths[0]); i++) {
+    for(int interleaving = 0; interleaving < 2; interleaving++) {
+      for(int rowSync = 0; rowSync < 2; rowSync++) {
+        pass &= checkWaveform(depths[i], interleaving, rowSync);
+      }
+    }
+  }
+
+  printf("Interrupts:\n");
+  pass &= checkInterrupts(1, false);
+  pass &= checkInterrupts(1, true);
+  pass &= checkInterrupts(POV_BIT_DEPTH, true);
+
+  printf("Upside down:\n");
+  setFlipped(true);
+  pass &= checkWaveform(MAX_BIT_DEPTH, false, false);
+  pass &= checkWaveform(POV_BIT_DEPTH, true, true);
+  pass &= checkDithering(POV_BIT_DEPTH);
+  setFlipped(false);
+
+  printf("Dithering:\n");
+  pass &= checkDithering(MAX_BIT_DEPTH);
+  pass &= checkDithering(POV_BIT_DEPTH);
+
+  printf("Frame cache:\n");
+  pass &= checkFrameCache();
+  pass &= checkDirectFrame();
+
+  printf("POV:\n");
+  pass &= runPov(SIM_TICK_RATE/5000);
+  pass &= runPov(SIM_TICK_RATE/1000);
+
+  printf("Power:\n");
+  pass &= checkStillness();
+  pass &= checkWake();
+
+  printf("Encoder:\n");
+  timeShow();
+  timeColumn();
+
+  return pass ? 0 : 1;
+}
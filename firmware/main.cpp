@@ -38,8 +38,10 @@
 #include "serialloop.h"
 #include "buttons.h"
 #include "matrix.h"
+#include "power.h"
+#include "mma8653.h"
 
-#include "animations/blinkinlabs.h"
+#include "animations/builtin.h"
 
 
 // Button inputs
@@ -65,6 +67,10 @@ private:
     uint32_t nextTime;           // Time to display next frame
     int frame;
 
+    // Frames are decoded here, then copied to the pixels, so that only the
+    // channels that changed get re-encoded
+    Pixel frameBuffer[LED_COUNT];
+
 public:
     void setup();
 
@@ -79,6 +85,7 @@ void TimedPlayer::setup() {
 
 void TimedPlayer::setAnimation(Animation *newAnimation) {
     animation = newAnimation;
+    animation->reset();
     nextTime = millis();
     frame = 0;
 }
@@ -88,16 +95,7 @@ void TimedPlayer::computeStep() {
         return;
     }
 
-    uint8_t* frameData = animation->getFrame(frame);
-
-    for (uint16_t col = 0; col < LED_COLS; col++) {
-        for (uint16_t row = 0; row < LED_ROWS; row++) {
-            setPixel(col, row,
-                frameData[(row*LED_COLS + col)*3 + 0],
-                frameData[(row*LED_COLS + col)*3 + 1],
-                frameData[(row*LED_COLS + col)*3 + 2]);
-        }
-    }
+    setPixels(animation->getFramePixels(frame, frameBuffer));
 
     frame = (frame + 1) % animation->frameCount;
     
@@ -114,23 +112,57 @@ void TimedPlayer::computeStep() {
 
 TimedPlayer timedPlayer;
 
+void setDisplayMode(uint8_t mode) {
+    displayMode = mode;
+
+    // POV and streamed frames should go out at the next row boundary
+    // rather than waiting for a whole refresh.
+    setRowSync(displayMode != DISPLAYMODE_TIMED);
+
+    // POV needs a fast refresh more than it needs color resolution
+    setBitDepth(displayMode == DISPLAYMODE_POV ? POV_BIT_DEPTH : MAX_BIT_DEPTH);
+
+    // Spread the light out over each refresh, so that colors don't
+    // break up while the pendant is swinging
+    setPlaneInterleaving(displayMode == DISPLAYMODE_POV);
+}
+
+// Each pattern brings its own display mode with it
 void setAnimation(unsigned int newAnimation) {
     Animation* animation;
 
-    if(getAnimationCount() == 0) {
-        animation = &blinkinlabsAnimation;
+    // With nothing in the animation flash, play the built in patterns
+    if(flashAnimations.getAnimationCount() == 0) {
+        currentAnimation = newAnimation%BUILTIN_ANIMATION_COUNT;
+
+        animation = builtinAnimations[currentAnimation].animation;
+        setDisplayMode(builtinAnimations[currentAnimation].displayMode);
     }
     else {
-        currentAnimation = newAnimation%getAnimationCount();
+        currentAnimation = newAnimation%flashAnimations.getAnimationCount();
 
-        loadAnimation(currentAnimation, &flashAnimation);
+        flashAnimations.loadAnimation(currentAnimation, &flashAnimation);
         animation = &flashAnimation;
+        setDisplayMode(flashAnimations.getDisplayMode(currentAnimation));
     }
 
     pov.setAnimation(animation);
     timedPlayer.setAnimation(animation);
 }
 
+// Turn the display round when the pendant is hung upside down. On its side,
+// it stays the way it was.
+void updateOrientation() {
+    uint8_t orientation = pov.orientation;
+
+    if(orientation == ORIENTATION_UPRIGHT && getFlipped()) {
+        setFlipped(false);
+    }
+    else if(orientation == ORIENTATION_UPSIDE_DOWN && !getFlipped()) {
+        setFlipped(true);
+    }
+}
+
 extern "C" int main()
 {
 
@@ -145,6 +177,10 @@ extern "C" int main()
 
     matrixSetup();
 
+    // The POV engine computes frames faster than the display refreshes, so
+    // always display the newest one instead of dropping it.
+    setTripleBuffering(true);
+
     reloadAnimations = true;
 
     // Application main loop
@@ -156,7 +192,9 @@ extern "C" int main()
             // have been interrupted- call setup again to reset it.
             matrixSetup();
 
-            displayMode = getDisplayMode();
+            // Check the patterns once, here, rather than every time they're
+            // switched between
+            flashAnimations.validate();
 
             reloadAnimations = false;
             setAnimation(0);
@@ -164,31 +202,53 @@ extern "C" int main()
 
         userButtons.buttonTask();
 
+        updateOrientation();
+
         switch(displayMode) {
         case DISPLAYMODE_SERIALLOOP:
+            // Keep the dithering going too, but don't put up half of a
+            // frame that's still coming in
+            if(serialFrameComplete() && !bufferWaiting()) {
+                show();
+            }
             break;
 
         case DISPLAYMODE_TIMED:
             timedPlayer.computeStep();
+
+            // Keep feeding the display between frames, so the dithering
+            // carries on
+            if(!bufferWaiting()) {
+                show();
+            }
             break;
 
         case DISPLAYMODE_POV:
         default:
-            // Use the POV engine to determine the current mode
+            // The POV engine gets the next frame ready, and puts it up
+            // itself (from a timer interrupt) when it's due
             pov.computeStep();
-            show();
             break;
         }
 
         // Check for serial data
         if(usb_serial_available() > 0) {
-            displayMode = DISPLAYMODE_SERIALLOOP;
+            // Streamed frames get the display to themselves, so the POV
+            // timer mustn't put up a frame that it had waiting
+            if(displayMode != DISPLAYMODE_SERIALLOOP) {
+                pov.cancelFrame();
+                setDisplayMode(DISPLAYMODE_SERIALLOOP);
+            }
             while(usb_serial_available() > 0) {
                 serialLoop();
                 watchdog_refresh();
             }
         }
 
+        // Sleep if the pendant has been put down. Everything is restarted
+        // on the way back up.
+        power.powerTask();
+
         // Finally, check for user button change
         if(userButtons.isPressed()) {
             uint8_t button = userButtons.getPressed();
@@ -6,7 +6,7 @@
 import math
 
 inputBitDepth = 8
-outputBitDepth = 8
+outputBitDepth = 16
 
 inputScale = (1 << inputBitDepth)       # Number of input steps
 outputScale = (1 << outputBitDepth)     # Number of output steps
@@ -22,7 +22,7 @@ out.write("#define BRIGHTNESS_TABLE_H\n")
 out.write("\n")
 out.write("#define BRIGHTNESS_STEPS %i\n" % (inputScale))
 out.write("\n")
-out.write("uint16_t brightnessTable[BRIGHTNESS_STEPS] = {\n")
+out.write("const uint16_t brightnessTable[BRIGHTNESS_STEPS] = {\n")
 
 for i in range(0, inputScale):
     brightness = int(math.pow(float(i)/inputScale,2) * outputScale)
@@ -75,52 +75,221 @@ uint8_t OUTPUT_ORDER[] = {
     13, // B4
 };
 
+// The same, with the columns the other way round (see setFlipped())
+uint8_t FLIPPED_OUTPUT_ORDER[] = {
+    14, // R0
+    12, // G0
+    13, // B0
+    11, // R1
+    9,  // G1
+    10, // B1
+    8,  // R2
+    6,  // G2
+    7,  // B2
+    5,  // R3
+    3,  // G3
+    4,  // B3
+    2,  // R4
+    0,  // G4
+    1,  // B4
+};
+
+// Row that each pixel row is encoded into
+const uint8_t ROW_ORDER[LED_ROWS] = {0, 1};
+const uint8_t FLIPPED_ROW_ORDER[LED_ROWS] = {1, 0};
+
+// Tables that the encoder is using; flipping the display just swaps them
+const uint8_t* outputOrder = OUTPUT_ORDER;
+const uint8_t* rowOrder = ROW_ORDER;
+
 // Display buffer (write into this!)
 Pixel pixels[LED_ROWS * LED_COLS];
 
-float systemBrightness = 1;
+// Output color lookup tables, combining the gamma curve in brightnessTable
+// with the system brightness and the white balance. These are rebuilt
+// whenever one of those changes, so encoding a channel is a single lookup.
+// The output is 16 bits; whatever doesn't fit in bitDepth is dithered.
+uint16_t colorTables[BYTES_PER_PIXEL][BRIGHTNESS_STEPS];
+
+uint16_t brightnessScale = 256;                     // System brightness, from 0 (off) to 256 (fully on)
+uint16_t whiteBalance[BYTES_PER_PIXEL] = {256, 256, 256};  // Per-channel scale, from 0 (off) to 256 (fully on)
+
+// Bit plane schedule
+// A refresh is made up of a sequence of slots, each of which shows one bit
+// plane (or a slice of one) of one row. Normally each row gets bitDepth slots
+// in a row, one for each plane, with on times that double from one plane to
+// the next. With plane interleaving (Binary Code Modulation), the top
+// BCM_SPLIT_PLANES planes are cut into equal slices that are spread between
+// the short planes, and the rows take turns slot by slot, so the light from
+// each refresh is spread evenly over it instead of bunching up in the MSBs.
+// The address and timer tables below, and the DMA buffers, all follow the
+// slot order.
+#define BCM_SPLIT_PLANES 3          // Number of planes that get split into slices when interleaving
+#define MAX_ROW_SLOTS (MAX_BIT_DEPTH - BCM_SPLIT_PLANES + (1 << BCM_SPLIT_PLANES) - 1)
+#define MAX_SLOTS (MAX_ROW_SLOTS*LED_ROWS)
+
+bool planeInterleaving;             // If true, use the interleaved schedule
+int rowSlots;                       // Number of slots for each row in the current schedule
+
+uint8_t slotRows[MAX_SLOTS];        // Row shown in each slot
+uint8_t slotPlanes[MAX_SLOTS];      // Bit plane shown in each slot
+uint8_t slotWeights[MAX_SLOTS];     // On time of each slot, as a power of 2 of the shortest one
 
 // Address output buffer
 // Note: We repeat the address output multiple times, to add a delay between OE deasserting and the address lines changing
 #define ADDRESS_REPEAT_COUNT 10  // was 10
-uint8_t Addresses[BIT_DEPTH*LED_ROWS*ADDRESS_REPEAT_COUNT];
+uint8_t Addresses[MAX_SLOTS*ADDRESS_REPEAT_COUNT];
 
 // Timer output buffers (these will be DMAd to the FTM0_MOD and FTM0_C1V registers)
-uint32_t FTM0_MODStates[BIT_DEPTH*LED_ROWS];
-uint32_t FTM0_C1VStates[BIT_DEPTH*LED_ROWS];
+uint32_t FTM0_MODStates[MAX_SLOTS];
+uint32_t FTM0_C1VStates[MAX_SLOTS];
+
+// Number of bit planes currently being displayed. The tables above and the
+// DMA buffers are laid out for this depth, with the unused space at the end.
+int bitDepth = MAX_BIT_DEPTH;
+
+// Length of one refresh, in FTM0 ticks (for the current bit depth)
+uint32_t refreshTicks;
 
 // Big 'ol waveform that should be sent out over DMA in chunks.
-// There are LED_ROWS separate loops, where the LED matrix address lines
-// to be set before they are activated.
-// For each of these rows, there are then BIT_DEPTH separate inner loops
-// And each inner loop has LED_COLS * 2 bytes states (the data is LED_COLS long, plus the clock signal is baked in)
+// There is one chunk for each slot in the schedule, and each chunk has
+// LED_COLS * 2 bytes states (the data is LED_COLS long, plus the clock signal is baked in).
+// A bit plane that is split into several slices is copied into each of them.
+// For row sync, the waveform is divided into LED_ROWS segments of rowSlots
+// slots each; without interleaving, each segment is exactly one row.
 
 #define ROW_BIT_SIZE (LED_COLS*BYTES_PER_PIXEL*2)                  // Number of bytes required to store a single row of 1-bit color data output
-#define ROW_DEPTH_SIZE (ROW_BIT_SIZE*BIT_DEPTH)                    // Number of bytes required to store a single row of full-color data output
-#define PANEL_DEPTH_SIZE (ROW_DEPTH_SIZE*LED_ROWS)                 // Number of bytes required to store an entire panel's worth of data output.
-
-// 2x DMA buffer
-// Note: Extra ROW_BIT_SIZE at end to account for extra DMA transfer
-// TODO: Trigger int from last address and skip the extra data transfer?
-uint8_t dmaBuffer[2][PANEL_DEPTH_SIZE];
+#define SEGMENT_SIZE (ROW_BIT_SIZE*rowSlots)                       // Number of bytes required to store one segment of the waveform
+#define PANEL_DEPTH_SIZE (ROW_BIT_SIZE*MAX_SLOTS)                  // Number of bytes required to store an entire panel's worth of data output, for the longest schedule.
+
+#define ROW_BIT_WORDS (ROW_BIT_SIZE/2)      // Number of halfwords in a single row of 1-bit color data output
+
+// Where each row's bit planes go in the waveform: the offset (in halfwords)
+// of the first slot showing each plane, and the other slots that show a
+// slice of the same plane and are copied from it.
+uint16_t planeOffsets[LED_ROWS][MAX_BIT_DEPTH];
+uint8_t sliceSlots[LED_ROWS][MAX_ROW_SLOTS];
+int sliceCount;                     // Number of extra slices for each row
+
+// 3x DMA buffer
+// The DMA engine's data TCD images always point at the newest finished frame
+// (the front buffer). The engine can still be sending out an older buffer
+// until it next reloads its data TCD, so show() encodes into whichever buffer
+// is neither of those.
+// The frame cache slots come after the three working buffers. They're shown
+// straight from where they are, so they have to be in the same array.
+#define DMA_BUFFER_COUNT 3
+#define ALL_BUFFER_COUNT (DMA_BUFFER_COUNT + FRAME_CACHE_SLOTS)
+uint8_t dmaBuffer[ALL_BUFFER_COUNT][PANEL_DEPTH_SIZE] __attribute__ ((aligned(4)));
 uint8_t* frontBuffer;
-uint8_t* backBuffer;
-volatile bool swapBuffers;
-
-void pixelsToDmaBuffer(Pixel* pixelInput, uint8_t bufferOutput[]);
-
-void setupTCD0(uint32_t* source, int minorLoopSize, int majorLoops);
-void setupTCD1(uint32_t* source, int minorLoopSize, int majorLoops);
-void setupTCD2(uint8_t* source, int minorLoopSize, int majorLoops);
-void setupTCD3(uint8_t* source, int minorLoopSize, int majorLoops);
-void dma_ch2_isr(void);
+volatile bool swapBuffers;          // True if the front buffer hasn't started being displayed yet
+
+bool tripleBuffering;               // If true, a new frame replaces a pending one instead of being dropped
+
+volatile int preparedBuffer = -1;   // Buffer encoded by prepare() and waiting for present(), or -1 for none
+
+// Frame cache: the caller's key for the frame in each slot, and when it was
+// last used (for finding the least recently used one)
+uint32_t cacheKeys[FRAME_CACHE_SLOTS];
+uint32_t cacheUses[FRAME_CACHE_SLOTS];
+bool cacheValid[FRAME_CACHE_SLOTS];
+uint32_t cacheUseCount;             // Counts up on every use
+FrameCacheStats frameCacheStats;
+
+static_assert(FRAME_CACHE_SLOTS >= 3, "The display can be using two cache slots, and one has to be free");
+
+// Frame bookkeeping, for reporting back to the frame producer
+uint32_t frameNumbers[ALL_BUFFER_COUNT];    // Frame number encoded in each buffer
+uint32_t nextFrameNumber;
+uint32_t frameShowTimes[ALL_BUFFER_COUNT];  // Time that each buffer was passed to show(), in us
+volatile DisplayStats displayStats;
+FramePresentedCallback framePresentedCallback;
+
+// Channels that have changed since each DMA buffer was last encoded. There is
+// one bit per channel (R, G or B of a pixel) in each row, so that show() only
+// has to re-encode what setPixel() actually changed.
+#define ALL_CHANNELS ((1 << (LED_COLS*BYTES_PER_PIXEL)) - 1)
+uint16_t staleChannels[DMA_BUFFER_COUNT][LED_ROWS];
+
+// Temporal dithering
+// Each channel keeps the part of its value that was too small to display
+// (its error), and adds it to the value the next time it is encoded, so that
+// over several refreshes the average output matches the full 16-bit value.
+// A frame's errors only count once it's actually been displayed, so every
+// buffer gets its own copy. Channels with a nonzero error are re-encoded on
+// every show(), whether or not they changed.
+bool dithering = true;
+uint16_t ditherErrors[DMA_BUFFER_COUNT][LED_COUNT*BYTES_PER_PIXEL];
+volatile int ditherBuffer;                  // Buffer holding the errors for the frame on the display
+uint16_t ditherChannels[LED_ROWS];          // Channels that need to be dithered
+
+void markAllStale();
+void fillColorTables();
+void pixelsToDmaBuffer(const Pixel* pixelInput, uint8_t bufferOutput[]);
+void updateDmaBuffer(Pixel* pixelInput, int buffer);
+
+// Image of a DMA transfer control descriptor, laid out like the DMA_TCDn_*
+// registers. The DMA engine reloads its TCDs from these by itself at the end
+// of each major loop (scatter/gather), so the display runs without any help
+// from the CPU. They need to be 32-byte aligned for that to work.
+struct TCD {
+  uint32_t SADDR;
+  int16_t SOFF;
+  uint16_t ATTR;
+  uint32_t NBYTES;
+  int32_t SLAST;
+  uint32_t DADDR;
+  int16_t DOFF;
+  uint16_t CITER;
+  int32_t DLASTSGA;
+  uint16_t CSR;
+  uint16_t BITER;
+} __attribute__ ((aligned(32)));
+
+static_assert(sizeof(TCD) == 32, "TCD image must match the DMA_TCDn registers");
+
+#define DMA_TCD(n) ((volatile TCD*)&DMA_TCD0_SADDR + (n))
+#define TCD_ADDRESS(x) ((uint32_t)(uintptr_t)(x))
+
+TCD timerTCD;               // DMA0 images: FTM0_MOD updates
+TCD onTimeTCD;              // DMA1 images: FTM0_C1V updates
+TCD addressTCD;             // DMA2 images: address line updates
+TCD dataTCDs[LED_ROWS];     // DMA3 images: pixel data, one per segment in row sync mode
+int dataTCDCount;           // Number of DMA3 images in use
+
+void setupTCD0(TCD* tcd, uint32_t* source, int minorLoopSize, int majorLoops);
+void setupTCD1(TCD* tcd, uint32_t* source, int minorLoopSize, int majorLoops);
+void setupTCD2(TCD* tcd, uint8_t* source, int minorLoopSize, int majorLoops);
+void setupTCD3(TCD* tcd, uint8_t* source, int minorLoopSize, int majorLoops, TCD* next);
+void loadTCD(int channel, const TCD* image);
+void setDataInterrupts(bool enable);
+void dma_ch3_isr(void);
 void setupTCDs();
 void setupFTM0();
+void fillSchedule();
+void fillAddresses();
+void fillTimerStates();
+int liveBufferIndex();
+int spareBufferIndex();
+void presentBuffer(int buffer);
+
+// If true, the pixel data is reloaded after every row instead of after every
+// refresh, so that a new frame can be picked up at any row boundary.
+bool rowSync;
 
 void matrixStart() {
     setupTCDs();
 }
 
+void matrixStop() {
+    DMA_CERQ = DMA_CERQ_CERQ(0);
+    FTM0_SC = 0;
+
+    // Take the output enable back from FTM0, and hold the LEDs off
+    pinMode(LED_OE_PIN, OUTPUT);
+    digitalWriteFast(LED_OE_PIN, HIGH);
+}
+
 void matrixSetup() {
   // Set all the pins to outputs
   pinMode(S0, OUTPUT);
@@ -131,83 +300,7 @@ void matrixSetup() {
   pinMode(LED_STROBE_PIN, OUTPUT);
   pinMode(LED_OE_PIN, OUTPUT);
 
-  // Fill the address table
-  // To make the DMA engine easier to program, we store a copy of the address table for each output page.
-  for(int address = 0; address < LED_ROWS; address++) {
-    for(int page = 0; page < BIT_DEPTH; page++) {
-      int last_address;
-      if(page == 0) {
-        last_address = (address + LED_ROWS - 1)%(LED_ROWS);
-      }
-      else {
-        last_address = address;
-      }
-
-#define addressBits(addr) (~((1<<DMA_STB_SHIFT) | (1<<(addr+DMA_S0_SHIFT))))
-
-      for(int i = 0; i < ADDRESS_REPEAT_COUNT; i++) {
-        // Note: We're actually pumping out the last address here, to avoid changing it too soon after
-        // deasserting enable.
-        //Addresses[(address*BIT_DEPTH + page)*ADDRESS_REPEAT_COUNT + i] = (0x3F & ~(1 << last_address));
-        Addresses[(address*BIT_DEPTH + page)*ADDRESS_REPEAT_COUNT + i] = addressBits(last_address);
-      }
-      
-      // TODO: Inserted to cause extra delay between OE and address change.
-      Addresses[(address*BIT_DEPTH + page)*ADDRESS_REPEAT_COUNT + ADDRESS_REPEAT_COUNT - 2] = addressBits(address) | (1 << DMA_STB_SHIFT);
-      Addresses[(address*BIT_DEPTH + page)*ADDRESS_REPEAT_COUNT + ADDRESS_REPEAT_COUNT - 1] = addressBits(address);
-    }
-  }
-
-
-  // Fill the timer states table
-  for(int address = 0; address < LED_ROWS; address++) {
-
-    // Each row update consists of BIT_DEPTH cycles. The length of the 'on' time
-    // (when OE is asserted) on each cycle is set by onTime; it begins with
-    // ON_TIME_MIN and doubles every cycle after that to create a binary progression.
-    // TODO: What does this translate to, in time?
-//    #define LOW_BIT_ENABLE_TIME     0x1             // Shortest OE on interval; the shorter, the dimmer the lowest bit.
-    
-    #define LOW_BIT_ENABLE_TIME     0x10             // Shortest OE on interval; the shorter, the dimmer the lowest bit.
-    // The interval between OE cycle is set by one of the three cases:
-    // 1. For low bits, where onTime is small, the interval is expanded to MIN_CYCLE_TIME
-    // 2. For longer bits, where onTime is longer, the cycle time is calculated as onTime + MIN_BLANKING_TIME
-    // 3. For the last cycle of the last row, the cycle time is expanded to MIN_LAST_CYCLE_TIME to allow
-    //    the display interrupt to update.
-
-    #define MIN_BLANKING_TIME       0x50        // Minimum time between OE assertions
-    #define MIN_CYCLE_TIME          0x05F       // 
-    #define MIN_LAST_CYCLE_TIME     0x0120      // Mininum number of cycles for the last cycle loop.
-
-
-    int onTime = LOW_BIT_ENABLE_TIME;               
-
-    for(int page = 0; page < BIT_DEPTH; page++) {
-      if((address == LED_ROWS -1)
-         && (page == BIT_DEPTH - 2)
-         && ((onTime + MIN_BLANKING_TIME) < MIN_LAST_CYCLE_TIME)) {
-        // On the second-to-last cycle, we need enough time to flush the DMA engines and handle the
-        // interrupt to reset the DMA engines. If the combination of blanking time and
-        // on time don't meet this, increase the timer cycle count to an acceptable length.
-        FTM0_C1VStates[address*BIT_DEPTH + page] = onTime;
-        FTM0_MODStates[address*BIT_DEPTH + page] = MIN_LAST_CYCLE_TIME;        
-      }      
-      else if((onTime + MIN_BLANKING_TIME) < MIN_CYCLE_TIME) {
-        // The DMA engines need enough time to write out the data after every cycle.
-        // WHen the on time is really low, the combination of blanking time and
-        // on time might not create a long enough delay to meet this, so we need to increase
-        // the timer cycle count to meet this requirement.
-        FTM0_C1VStates[address*BIT_DEPTH + page] = onTime;
-        FTM0_MODStates[address*BIT_DEPTH + page] = MIN_CYCLE_TIME;
-      }
-      else {
-        FTM0_C1VStates[address*BIT_DEPTH + page] = onTime;      
-        FTM0_MODStates[address*BIT_DEPTH + page] = onTime + MIN_BLANKING_TIME;
-      }
-
-      onTime = onTime*2;
-    }
-  }
+  fillSchedule();
 
   // DMA
   // Configure DMA
@@ -217,9 +310,9 @@ void matrixSetup() {
   // Configure the DMA request input for DMA0
   DMA_SERQ = DMA_SERQ_SERQ(0);
 
-  // Enable interrupt on major completion for DMA channel 2 (address)
-  DMA_TCD2_CSR = DMA_TCD_CSR_INTMAJOR;  // Enable interrupt on major complete
-  NVIC_ENABLE_IRQ(IRQ_DMA_CH2);         // Enable interrupt request
+  // The pixel data TCDs only interrupt while a new frame is waiting to go
+  // out (see presentBuffer() and dma_ch3_isr())
+  NVIC_ENABLE_IRQ(IRQ_DMA_CH3);         // Enable interrupt request
 
   // DMAMUX
   // Configure the DMAMUX
@@ -230,37 +323,438 @@ void matrixSetup() {
   DMAMUX0_CHCFG0 = DMAMUX_DISABLE;
   DMAMUX0_CHCFG0 = DMAMUX_SOURCE_FTM0_CH1 | DMAMUX_ENABLE;
 
+  // None of the buffers hold a valid waveform yet, so encode everything
+  fillColorTables();
+  markAllStale();
+
+  frontBuffer = dmaBuffer[0];
+  swapBuffers = false;
+  updateDmaBuffer(pixels, 0);
+
   // Load this frame of data into the DMA engine
   setupTCDs();
 
   // FTM
   SIM_SCGC6 |= SIM_SCGC6_FTM0;  // Enable FTM0 clock
   setupFTM0();
+}
 
-  frontBuffer = dmaBuffer[0];
-  backBuffer = dmaBuffer[1];
-  swapBuffers = false;
+// Lay out the slots for the current bit depth and plane order, and fill
+// everything that depends on it: the address and timer tables, and the
+// encoder's plane positions.
+void fillSchedule() {
+  // The order that the slots of each row are shown in, as (plane, weight)
+  uint8_t rowPlanes[MAX_ROW_SLOTS];
+  uint8_t rowWeights[MAX_ROW_SLOTS];
+
+  if(!planeInterleaving) {
+    rowSlots = bitDepth;
+    for(int plane = 0; plane < bitDepth; plane++) {
+      rowPlanes[plane] = plane;
+      rowWeights[plane] = plane;
+    }
+  }
+  else {
+    // Planes below splitPlane are shown whole. The ones above it are cut
+    // into slices with the same weight as splitPlane, and ordered so that
+    // each plane's slices are spread out (4 3 4 2 4 3 4, for 3 split planes).
+    int splitPlane = bitDepth - BCM_SPLIT_PLANES;
+    if(splitPlane < 0) {
+      splitPlane = 0;
+    }
+
+    int longCount = (1 << (bitDepth - splitPlane)) - 1;
+    int shortCount = splitPlane;
+
+    // Then alternate the slices with the short planes
+    rowSlots = 0;
+    for(int i = 0; i < longCount || i < shortCount; i++) {
+      if(i < longCount) {
+        rowPlanes[rowSlots] = bitDepth - 1 - __builtin_ctz(i + 1);
+        rowWeights[rowSlots] = splitPlane;
+        rowSlots++;
+      }
+      if(i < shortCount) {
+        rowPlanes[rowSlots] = i;
+        rowWeights[rowSlots] = i;
+        rowSlots++;
+      }
+    }
+  }
+
+  // Lay the rows out one after the other, or take turns when interleaving
+  for(int row = 0; row < LED_ROWS; row++) {
+    for(int i = 0; i < rowSlots; i++) {
+      int slot = planeInterleaving ? (i*LED_ROWS + row) : (row*rowSlots + i);
+
+      slotRows[slot] = row;
+      slotPlanes[slot] = rowPlanes[i];
+      slotWeights[slot] = rowWeights[i];
+    }
+  }
+
+  // Encode each plane into its first slot, and copy it to the rest
+  sliceCount = 0;
+  for(int row = 0; row < LED_ROWS; row++) {
+    uint8_t placed = 0;
+    int slices = 0;
+
+    for(int slot = 0; slot < rowSlots*LED_ROWS; slot++) {
+      if(slotRows[slot] != row) {
+        continue;
+      }
+
+      int plane = slotPlanes[slot];
+      if(placed & (1 << plane)) {
+        sliceSlots[row][slices++] = slot;
+      }
+      else {
+        planeOffsets[row][plane] = slot*ROW_BIT_WORDS;
+        placed |= 1 << plane;
+      }
+    }
+    sliceCount = slices;
+  }
 
-  // Clear the display
-  memset(backBuffer, 0, LED_ROWS*LED_COLS);
-  show();
+  fillAddresses();
+  fillTimerStates();
+}
+
+// Fill the address table
+void fillAddresses() {
+  // To make the DMA engine easier to program, we store a copy of the address table for each output page.
+  int slotCount = rowSlots*LED_ROWS;
+
+  for(int slot = 0; slot < slotCount; slot++) {
+    int address = slotRows[slot];
+    int last_address = slotRows[(slot + slotCount - 1)%slotCount];
+
+#define addressBits(addr) (~((1<<DMA_STB_SHIFT) | (1<<(addr+DMA_S0_SHIFT))))
+
+    for(int i = 0; i < ADDRESS_REPEAT_COUNT; i++) {
+      // Note: We're actually pumping out the last address here, to avoid changing it too soon after
+      // deasserting enable.
+      //Addresses[slot*ADDRESS_REPEAT_COUNT + i] = (0x3F & ~(1 << last_address));
+      Addresses[slot*ADDRESS_REPEAT_COUNT + i] = addressBits(last_address);
+    }
+
+    // TODO: Inserted to cause extra delay between OE and address change.
+    Addresses[slot*ADDRESS_REPEAT_COUNT + ADDRESS_REPEAT_COUNT - 2] = addressBits(address) | (1 << DMA_STB_SHIFT);
+    Addresses[slot*ADDRESS_REPEAT_COUNT + ADDRESS_REPEAT_COUNT - 1] = addressBits(address);
+  }
+}
+
+// Fill the timer states table
+void fillTimerStates() {
+  refreshTicks = 0;
+
+  // The length of the 'on' time (when OE is asserted) on each cycle is set
+  // by onTime; it is LOW_BIT_ENABLE_TIME for the least significant plane,
+  // and doubles with every plane after that to create a binary progression.
+  // TODO: What does this translate to, in time?
+//    #define LOW_BIT_ENABLE_TIME     0x1             // Shortest OE on interval; the shorter, the dimmer the lowest bit.
+
+  #define LOW_BIT_ENABLE_TIME     0x10             // Shortest OE on interval; the shorter, the dimmer the lowest bit.
+  // The interval between OE cycle is set by one of the two cases:
+  // 1. For low bits, where onTime is small, the interval is expanded to MIN_CYCLE_TIME
+  // 2. For longer bits, where onTime is longer, the cycle time is calculated as onTime + MIN_BLANKING_TIME
+  // The DMA engine reloads itself between refreshes, so the last cycle doesn't need any extra
+  // time for the display interrupt.
+
+  #define MIN_BLANKING_TIME       0x50        // Minimum time between OE assertions
+  #define MIN_CYCLE_TIME          0x05F       // 
+
+  for(int slot = 0; slot < rowSlots*LED_ROWS; slot++) {
+    int onTime = LOW_BIT_ENABLE_TIME << slotWeights[slot];
+
+    if((onTime + MIN_BLANKING_TIME) < MIN_CYCLE_TIME) {
+      // The DMA engines need enough time to write out the data after every cycle.
+      // WHen the on time is really low, the combination of blanking time and
+      // on time might not create a long enough delay to meet this, so we need to increase
+      // the timer cycle count to meet this requirement.
+      FTM0_C1VStates[slot] = onTime;
+      FTM0_MODStates[slot] = MIN_CYCLE_TIME;
+    }
+    else {
+      FTM0_C1VStates[slot] = onTime;
+      FTM0_MODStates[slot] = onTime + MIN_BLANKING_TIME;
+    }
+
+    refreshTicks += FTM0_MODStates[slot] + 1;
+  }
 }
 
 bool bufferWaiting() {
     return swapBuffers;
 }
 
-void show() {
-    if(swapBuffers) {
+void setTripleBuffering(bool enable) {
+    tripleBuffering = enable;
+}
+
+void setFramePresentedCallback(FramePresentedCallback callback) {
+    framePresentedCallback = callback;
+}
+
+// Stop the display, lay out the schedule again, and restart it. Pending
+// frames were encoded for the old layout, so start over with the front buffer.
+void rebuildSchedule() {
+    DMA_CERQ = DMA_CERQ_CERQ(0);
+
+    fillSchedule();
+
+    markAllStale();
+    clearFrameCache();
+    swapBuffers = false;
+    preparedBuffer = -1;
+
+    int front = (frontBuffer - dmaBuffer[0])/PANEL_DEPTH_SIZE;
+    if(front >= DMA_BUFFER_COUNT) {
+        front = 0;
+        frontBuffer = dmaBuffer[0];
+    }
+    updateDmaBuffer(pixels, front);
+
+    setupTCDs();
+}
+
+void setBitDepth(int depth) {
+    if(depth < 1) {
+        depth = 1;
+    }
+    else if(depth > MAX_BIT_DEPTH) {
+        depth = MAX_BIT_DEPTH;
+    }
+
+    if(depth == bitDepth) {
+        return;
+    }
+
+    bitDepth = depth;
+    rebuildSchedule();
+}
+
+void setPlaneInterleaving(bool enable) {
+    if(enable == planeInterleaving) {
+        return;
+    }
+
+    planeInterleaving = enable;
+    rebuildSchedule();
+}
+
+int getBitDepth() {
+    return bitDepth;
+}
+
+uint32_t getRefreshRate() {
+    // FTM0 runs from the bus clock, divided by 2 (see setupFTM0())
+    return (F_BUS/2)/refreshTicks;
+}
+
+void setRowSync(bool enable) {
+    if(enable == rowSync) {
         return;
     }
-    
-    // Wait until the last buffer is written out
-//    while(swapBuffers) {}
 
-    pixelsToDmaBuffer(pixels, backBuffer);
-    // TODO: Atomic operation?
+    // The data TCD images are laid out differently, so the DMA engine has to
+    // be restarted with them.
+    rowSync = enable;
+    setupTCDs();
+}
+
+void setFlipped(bool enable) {
+    outputOrder = enable ? FLIPPED_OUTPUT_ORDER : OUTPUT_ORDER;
+    rowOrder = enable ? FLIPPED_ROW_ORDER : ROW_ORDER;
+
+    // Everything was encoded the other way round
+    markAllStale();
+    clearFrameCache();
+}
+
+bool getFlipped() {
+    return rowOrder == FLIPPED_ROW_ORDER;
+}
+
+DisplayStats getDisplayStats() {
+    DisplayStats stats;
+    stats.framesPresented = displayStats.framesPresented;
+    stats.framesDropped = displayStats.framesDropped;
+    stats.lastLatency = displayStats.lastLatency;
+    stats.maxLatency = displayStats.maxLatency;
+    return stats;
+}
+
+uint32_t show() {
+    if(swapBuffers && !tripleBuffering) {
+        displayStats.framesDropped++;
+        return 0;
+    }
+
+    // The spare buffer might be the prepared one
+    preparedBuffer = -1;
+
+    int buffer = spareBufferIndex();
+    updateDmaBuffer(pixels, buffer);
+    frameNumbers[buffer] = ++nextFrameNumber;
+    frameShowTimes[buffer] = micros();
+
+    presentBuffer(buffer);
+
+    return nextFrameNumber;
+}
+
+uint32_t prepare() {
+    // Take back the last prepared frame, so that present() can't pick it up
+    // half encoded
+    preparedBuffer = -1;
+    asm volatile("" : : : "memory");
+
+    int buffer = spareBufferIndex();
+    updateDmaBuffer(pixels, buffer);
+    frameNumbers[buffer] = ++nextFrameNumber;
+
+    asm volatile("" : : : "memory");    // Finish the buffer before offering it
+    preparedBuffer = buffer;
+
+    return nextFrameNumber;
+}
+
+uint32_t prepareFrom(const Pixel* frame) {
+    preparedBuffer = -1;
+    asm volatile("" : : : "memory");
+
+    int buffer = spareBufferIndex();
+    pixelsToDmaBuffer(frame, dmaBuffer[buffer]);
+    frameNumbers[buffer] = ++nextFrameNumber;
+
+    // The buffer doesn't hold the pixels any more, and has nothing to dither
+    for(int row = 0; row < LED_ROWS; row++) {
+        staleChannels[buffer][row] = ALL_CHANNELS;
+    }
+    memset(ditherErrors[buffer], 0, sizeof(ditherErrors[buffer]));
+
+    asm volatile("" : : : "memory");    // Finish the buffer before offering it
+    preparedBuffer = buffer;
+
+    return nextFrameNumber;
+}
+
+bool present() {
+    int buffer = preparedBuffer;
+    if(buffer < 0) {
+        return false;
+    }
+    preparedBuffer = -1;
+
+    frameShowTimes[buffer] = micros();
+    presentBuffer(buffer);
+    return true;
+}
+
+bool prepareCached(uint32_t key) {
+    for(int slot = 0; slot < FRAME_CACHE_SLOTS; slot++) {
+        if(cacheValid[slot] && cacheKeys[slot] == key) {
+            cacheUses[slot] = ++cacheUseCount;
+            frameCacheStats.hits++;
+
+            int buffer = DMA_BUFFER_COUNT + slot;
+            frameNumbers[buffer] = ++nextFrameNumber;
+            preparedBuffer = buffer;
+            return true;
+        }
+    }
+
+    frameCacheStats.misses++;
+    return false;
+}
+
+uint32_t prepareAndCache(uint32_t key) {
+    return prepareAndCacheFrom(key, pixels);
+}
+
+uint32_t prepareAndCacheFrom(uint32_t key, const Pixel* frame) {
+    preparedBuffer = -1;
+    asm volatile("" : : : "memory");
+
+    // Replace the least recently used slot that isn't on the display, or
+    // about to be. The display only ever has two buffers in use, so there's
+    // always one.
+    int live = liveBufferIndex() - DMA_BUFFER_COUNT;
+    int front = (frontBuffer - dmaBuffer[0])/PANEL_DEPTH_SIZE - DMA_BUFFER_COUNT;
+
+    int slot = -1;
+    for(int candidate = 0; candidate < FRAME_CACHE_SLOTS; candidate++) {
+        if(candidate == live || candidate == front) {
+            continue;
+        }
+        if(slot < 0 || !cacheValid[candidate]
+           || (cacheValid[slot] && cacheUses[candidate] < cacheUses[slot])) {
+            slot = candidate;
+        }
+    }
+
+    int buffer = DMA_BUFFER_COUNT + slot;
+    pixelsToDmaBuffer(frame, dmaBuffer[buffer]);
+    cacheKeys[slot] = key;
+    cacheUses[slot] = ++cacheUseCount;
+    cacheValid[slot] = true;
+    frameNumbers[buffer] = ++nextFrameNumber;
+
+    asm volatile("" : : : "memory");    // Finish the buffer before offering it
+    preparedBuffer = buffer;
+
+    return nextFrameNumber;
+}
+
+void clearFrameCache() {
+    for(int slot = 0; slot < FRAME_CACHE_SLOTS; slot++) {
+        cacheValid[slot] = false;
+    }
+}
+
+FrameCacheStats getFrameCacheStats() {
+    return frameCacheStats;
+}
+
+void clearFrameCacheStats() {
+    frameCacheStats.hits = 0;
+    frameCacheStats.misses = 0;
+}
+
+// Pick a buffer that the DMA engine isn't sending out. The only buffer that
+// it can switch to is the front buffer, so avoid that one too.
+int spareBufferIndex() {
+    int live = liveBufferIndex();
+    int front = (frontBuffer - dmaBuffer[0])/PANEL_DEPTH_SIZE;
+
+    int buffer = 0;
+    while(buffer == live || buffer == front) {
+        buffer++;
+    }
+    return buffer;
+}
+
+// Hand a newly encoded buffer over to the display. If the last one is still
+// waiting, it never made it to the display and is replaced by this one.
+void presentBuffer(int buffer) {
+    NVIC_DISABLE_IRQ(IRQ_DMA_CH3);
+    if(swapBuffers) {
+        displayStats.framesDropped++;
+    }
+
+    frontBuffer = dmaBuffer[buffer];
     swapBuffers = true;
+
+    // The DMA engine picks up the new frame the next time it loads a data TCD.
+    // Turn the interrupts on first, so that whichever image it loads the new
+    // frame from also tells us when that's gone out.
+    setDataInterrupts(true);
+    asm volatile("" : : : "memory");
+    for(int row = 0; row < dataTCDCount; row++) {
+        dataTCDs[row].SADDR = TCD_ADDRESS(frontBuffer + row*SEGMENT_SIZE);
+    }
+    NVIC_ENABLE_IRQ(IRQ_DMA_CH3);
 }
 
 void setPixel(int column, int row, uint8_t r, uint8_t g, uint8_t b) {
@@ -269,175 +763,409 @@ void setPixel(int column, int row, uint8_t r, uint8_t g, uint8_t b) {
         return;
     }
 
-    pixels[row*LED_COLS + column].R = r;
-    pixels[row*LED_COLS + column].G = g;
-    pixels[row*LED_COLS + column].B = b;
+    Pixel* pixel = &pixels[row*LED_COLS + column];
+    int channel = column*BYTES_PER_PIXEL;
+
+    uint16_t changed = 0;
+    if(pixel->R != r) { changed |= 1 << (channel + 0); }
+    if(pixel->G != g) { changed |= 1 << (channel + 1); }
+    if(pixel->B != b) { changed |= 1 << (channel + 2); }
+
+    if(changed == 0) {
+        return;
+    }
+
+    pixel->R = r;
+    pixel->G = g;
+    pixel->B = b;
+
+    for(int buffer = 0; buffer < DMA_BUFFER_COUNT; buffer++) {
+        staleChannels[buffer][row] |= changed;
+    }
+}
+
+void setPixels(const Pixel* frame) {
+    for(int row = 0; row < LED_ROWS; row++) {
+        for(int column = 0; column < LED_COLS; column++) {
+            const Pixel& pixel = frame[row*LED_COLS + column];
+            setPixel(column, row, pixel.R, pixel.G, pixel.B);
+        }
+    }
 }
 
 Pixel* getPixels() {
+    // We can't see writes made through the returned pointer, so assume
+    // that everything is about to change.
+    markAllStale();
+
     return pixels;
 }
 
+void markAllStale() {
+    for(int buffer = 0; buffer < DMA_BUFFER_COUNT; buffer++) {
+        for(int row = 0; row < LED_ROWS; row++) {
+            staleChannels[buffer][row] = ALL_CHANNELS;
+        }
+    }
+}
+
 void setBrightness(float brightness) {
-    systemBrightness = brightness*brightness;
+    if(brightness < 0) {
+        brightness = 0;
+    }
+    else if(brightness > 1) {
+        brightness = 1;
+    }
+
+    brightnessScale = brightness*brightness*256;
+    fillColorTables();
+}
+
+void setDithering(bool enable) {
+    dithering = enable;
+    markAllStale();
+}
+
+void setWhiteBalance(uint8_t r, uint8_t g, uint8_t b) {
+    // Map 0-255 onto 0-256, so that 255 is exactly full scale
+    whiteBalance[0] = r + (r >> 7);
+    whiteBalance[1] = g + (g >> 7);
+    whiteBalance[2] = b + (b >> 7);
+    fillColorTables();
+}
+
+void fillColorTables() {
+    for(int color = 0; color < BYTES_PER_PIXEL; color++) {
+        uint32_t scale = brightnessScale*whiteBalance[color];   // 16.16 fixed point
+
+        for(int i = 0; i < BRIGHTNESS_STEPS; i++) {
+            colorTables[color][i] = (brightnessTable[i]*scale) >> 16;
+        }
+    }
+
+    // Everything on the display needs to be re-encoded with the new tables
+    markAllStale();
+    clearFrameCache();
+}
+
+// Each shift register position in a bit plane is two DMA bytes: the data
+// bit, then the same data bit with the clock raised. On a little-endian core
+// that pair can be written as a single halfword.
+#define PLANE_WORD(bit) \
+    ((uint16_t)(((bit) << DMA_DAT_SHIFT) \
+     | ((((bit) << DMA_DAT_SHIFT) | (1 << DMA_CLK_SHIFT)) << 8)))
+
+#define NIBBLE_PLANES(n) \
+    { PLANE_WORD(((n) >> 0) & 1), PLANE_WORD(((n) >> 1) & 1), \
+      PLANE_WORD(((n) >> 2) & 1), PLANE_WORD(((n) >> 3) & 1) }
+
+// Pre-clocked output halfwords for the four bit planes covered by a nibble
+const uint16_t nibblePlanes[16][4] = {
+    NIBBLE_PLANES(0),  NIBBLE_PLANES(1),  NIBBLE_PLANES(2),  NIBBLE_PLANES(3),
+    NIBBLE_PLANES(4),  NIBBLE_PLANES(5),  NIBBLE_PLANES(6),  NIBBLE_PLANES(7),
+    NIBBLE_PLANES(8),  NIBBLE_PLANES(9),  NIBBLE_PLANES(10), NIBBLE_PLANES(11),
+    NIBBLE_PLANES(12), NIBBLE_PLANES(13), NIBBLE_PLANES(14), NIBBLE_PLANES(15),
+};
+
+#if MAX_BIT_DEPTH > 8
+#error "encodeChannel() can't display more than 8 bits"
+#endif
+
+static_assert(sizeof(Pixel) == BYTES_PER_PIXEL, "Pixel must be packed RGB");
+
+// Transpose one bitDepth-bit channel value into all bitDepth planes of its
+// row, using the nibblePlanes table so the clock bits come for free.
+// @param offsets Position of each plane of the row, from planeOffsets
+static inline void encodeChannel(uint16_t* bufferOutput, const uint16_t* offsets, int channel, uint8_t data) {
+  const uint16_t* low = nibblePlanes[data & 0x0F];
+  const uint16_t* high = nibblePlanes[data >> 4];
+  uint16_t* output = bufferOutput + outputOrder[channel];
+
+  switch(bitDepth) {
+    case 8: output[offsets[7]] = high[3];  // fall through
+    case 7: output[offsets[6]] = high[2];  // fall through
+    case 6: output[offsets[5]] = high[1];  // fall through
+    case 5: output[offsets[4]] = high[0];  // fall through
+    case 4: output[offsets[3]] = low[3];   // fall through
+    case 3: output[offsets[2]] = low[2];   // fall through
+    case 2: output[offsets[1]] = low[1];   // fall through
+    case 1: output[offsets[0]] = low[0];
+  }
+}
+
+// Copy each of a row's split planes into the rest of its slices
+static inline void copySlices(uint8_t* bufferOutput, int row) {
+  for(int i = 0; i < sliceCount; i++) {
+    int slot = sliceSlots[row][i];
+    const uint16_t* source = (const uint16_t*)bufferOutput + planeOffsets[row][slotPlanes[slot]];
+    memcpy(bufferOutput + slot*ROW_BIT_SIZE, source, ROW_BIT_SIZE);
+  }
 }
 
 // Munge the data so it can be written out by the DMA engine
-// Note: bufferOutput[][xxx] should have BIT_DEPTH as xxx
-void pixelsToDmaBuffer(Pixel* pixelInput, uint8_t bufferOutput[]) {
+// Each channel is passed through colorTables on the way, and truncated to
+// bitDepth bits (without dithering).
+// Note: bufferOutput[][xxx] should have bitDepth as xxx
+void pixelsToDmaBuffer(const Pixel* pixelInput, uint8_t bufferOutput[]) {
+  const uint8_t* channels = (const uint8_t*)pixelInput;
+  const int shift = 16 - bitDepth;
+
   for(int row = 0; row < LED_ROWS; row++) {
+    uint16_t* planeOutput = (uint16_t*)bufferOutput;
+    const uint16_t* offsets = planeOffsets[rowOrder[row]];
+
     for(int col = 0; col < LED_COLS; col++) {
-      
-      // Data is the data to
-      int data_R = pixelInput[row*LED_COLS + col].R;
-      int data_G = pixelInput[row*LED_COLS + col].G;
-      int data_B = pixelInput[row*LED_COLS + col].B;
-
-      for(int depth = 0; depth < BIT_DEPTH; depth++) {
-        uint8_t output_r =
-            (((data_R >> depth) & 0x01) << DMA_DAT_SHIFT);
-        uint8_t output_g =
-            (((data_G >> depth) & 0x01) << DMA_DAT_SHIFT);
-        uint8_t output_b =
-            (((data_B >> depth) & 0x01) << DMA_DAT_SHIFT);
-
-        int offset_r = OUTPUT_ORDER[col*3 + 0];
-        int offset_g = OUTPUT_ORDER[col*3 + 1];
-        int offset_b = OUTPUT_ORDER[col*3 + 2];
-
-        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_r*2 + 0] = output_r;
-        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_r*2 + 1] = output_r | 1 << DMA_CLK_SHIFT;
-        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_g*2 + 0] = output_g;
-        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_g*2 + 1] = output_g | 1 << DMA_CLK_SHIFT;
-        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_b*2 + 0] = output_b;
-        bufferOutput[row*ROW_DEPTH_SIZE + depth*ROW_BIT_SIZE + offset_b*2 + 1] = output_b | 1 << DMA_CLK_SHIFT;
-      }
+      int channel = col*BYTES_PER_PIXEL;
+      encodeChannel(planeOutput, offsets, channel + 0, colorTables[0][*channels++] >> shift);
+      encodeChannel(planeOutput, offsets, channel + 1, colorTables[1][*channels++] >> shift);
+      encodeChannel(planeOutput, offsets, channel + 2, colorTables[2][*channels++] >> shift);
     }
+
+    copySlices(bufferOutput, rowOrder[row]);
   }
+}
+
+// Like pixelsToDmaBuffer(), but only re-encode the channels that are stale
+// in this buffer or need dithering, and then mark them as up to date.
+// @param buffer Index of the DMA buffer to update
+void updateDmaBuffer(Pixel* pixelInput, int buffer) {
+  uint8_t* bufferOutput = dmaBuffer[buffer];
+  uint16_t* staleRows = staleChannels[buffer];
+
+  // Carry on from the errors of the frame that's on the display now
+  const uint16_t* lastErrors = ditherErrors[ditherBuffer];
+  uint16_t* errors = ditherErrors[buffer];
+
+  const int shift = 16 - bitDepth;
+  const uint32_t maxValue = (1 << bitDepth) - 1;
+  const uint16_t errorMask = dithering ? (1 << shift) - 1 : 0;
+
+  for(int row = 0; row < LED_ROWS; row++) {
+    uint16_t stale = staleRows[row] | ditherChannels[row];
+    if(stale == 0) {
+      continue;
+    }
+    staleRows[row] = 0;
+
+    const uint8_t* channels = (const uint8_t*)(pixelInput + row*LED_COLS);
+    uint16_t* planeOutput = (uint16_t*)bufferOutput;
+    const uint16_t* offsets = planeOffsets[rowOrder[row]];
+    int index = row*LED_COLS*BYTES_PER_PIXEL;
+
+    uint16_t dithered = 0;
+    int color = 0;
+    for(int channel = 0; stale != 0; channel++, stale >>= 1) {
+      if(stale & 1) {
+        uint32_t value = colorTables[color][channels[channel]];
+        if(value & errorMask) {
+          value += lastErrors[index + channel] & errorMask;
+          dithered |= 1 << channel;
+        }
+
+        uint32_t output = value >> shift;
+        if(output > maxValue) {
+          output = maxValue;
+          value = maxValue << shift;
+        }
+
+        errors[index + channel] = value - (output << shift);
+        encodeChannel(planeOutput, offsets, channel, output);
+      }
+
+      if(++color == BYTES_PER_PIXEL) {
+        color = 0;
+      }
+    }
 
-  for(int pos= 0; pos < PANEL_DEPTH_SIZE/2; pos++) {
-        bufferOutput[pos*2 + 1] |= 1 << DMA_CLK_SHIFT;
+    copySlices(bufferOutput, rowOrder[row]);
+    ditherChannels[row] = dithered;
   }
 }
 
 
+// Note: Each channel triggers the next one after every minor loop, and on the
+// last minor loop (where the minor link isn't made) through the major link
+// instead. The TCDs then load themselves again from their images, so the
+// channels keep running in step from one refresh to the next.
+
 // TCD0 updates the timer values for FTM0
-void setupTCD0(uint32_t* source, int minorLoopSize, int majorLoops) {
-  DMA_TCD0_SADDR = source;                                        // Address to read from
-  DMA_TCD0_SOFF = 4;                                              // Bytes to increment source register between writes 
-  DMA_TCD0_ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);  // 32-bit input and output
-  DMA_TCD0_NBYTES_MLNO = minorLoopSize;                           // Number of bytes to transfer in the minor loop
-  DMA_TCD0_SLAST = 0;                                             // Bytes to add after a major iteration count (N/A)
-  //  DMA_TCD0_DADDR = TimerStatesDump;                               // Address to write to
-  DMA_TCD0_DADDR = &FTM0_MOD;                                      // Address to write to
-  DMA_TCD0_DOFF = 0;                                              // Bytes to increment destination register between write
-  //  DMA_TCD0_CITER_ELINKNO = majorLoops;                            // Number of major loops to complete
-  //  DMA_TCD0_BITER_ELINKNO = majorLoops;                            // Reset value for CITER (must be equal to CITER)
-  DMA_TCD0_DLASTSGA = 0;                                          // Address of next TCD (N/A)
-
-  // Workaround for DMA majorelink unreliability: increase the minor loop count by one
-  // Note that the final transfer doesn't end up happening, because 
-  DMA_TCD0_CITER_ELINKYES = majorLoops + 1;                           // Number of major loops to complete
-  DMA_TCD0_BITER_ELINKYES = majorLoops + 1;                           // Reset value for CITER (must be equal to CITER)
+void setupTCD0(TCD* tcd, uint32_t* source, int minorLoopSize, int majorLoops) {
+  tcd->SADDR = TCD_ADDRESS(source);                               // Address to read from
+  tcd->SOFF = 4;                                                  // Bytes to increment source register between writes 
+  tcd->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);      // 32-bit input and output
+  tcd->NBYTES = minorLoopSize;                                    // Number of bytes to transfer in the minor loop
+  tcd->SLAST = 0;                                                 // Bytes to add after a major iteration count (N/A)
+  tcd->DADDR = TCD_ADDRESS(&FTM0_MOD);                            // Address to write to
+  tcd->DOFF = 0;                                                  // Bytes to increment destination register between write
+  tcd->DLASTSGA = TCD_ADDRESS(tcd);                               // Address of next TCD (this one again)
 
   // Trigger DMA1 (timer) after each minor loop
-  DMA_TCD0_BITER_ELINKYES |= DMA_TCD_CITER_ELINK;
-  DMA_TCD0_BITER_ELINKYES |= (0x01 << 9);  
-  DMA_TCD0_CITER_ELINKYES |= DMA_TCD_CITER_ELINK;
-  DMA_TCD0_CITER_ELINKYES |= (0x01 << 9);
+  tcd->CITER = majorLoops | DMA_TCD_CITER_ELINK | (0x01 << 9);     // Number of major loops to complete
+  tcd->BITER = majorLoops | DMA_TCD_CITER_ELINK | (0x01 << 9);     // Reset value for CITER (must be equal to CITER)
+  tcd->CSR = DMA_TCD_CSR_ESG | DMA_TCD_CSR_MAJORELINK | DMA_TCD_CSR_MAJORLINKCH(1);
 }
 
 // TCD1 updates the timer values for FTM0
-void setupTCD1(uint32_t* source, int minorLoopSize, int majorLoops) {
-  DMA_TCD1_SADDR = source;                                        // Address to read from
-  DMA_TCD1_SOFF = 4;                                              // Bytes to increment source register between writes 
-  DMA_TCD1_ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);  // 32-bit input and output
-  DMA_TCD1_NBYTES_MLNO = minorLoopSize;                           // Number of bytes to transfer in the minor loop
-  DMA_TCD1_SLAST = 0;                                             // Bytes to add after a major iteration count (N/A)
-  //  DMA_TCD0_DADDR = TimerStatesDump;                               // Address to write to
-  DMA_TCD1_DADDR = &FTM0_C1V;                                      // Address to write to
-  DMA_TCD1_DOFF = 0;                                              // Bytes to increment destination register between write
-  //  DMA_TCD1_CITER_ELINKNO = majorLoops;                            // Number of major loops to complete
-  //  DMA_TCD1_BITER_ELINKNO = majorLoops;                            // Reset value for CITER (must be equal to CITER)
-  DMA_TCD1_DLASTSGA = 0;                                          // Address of next TCD (N/A)
-
-  // Workaround for DMA majorelink unreliability: increase the minor loop count by one
-  // Note that the final transfer doesn't end up happening, because 
-  DMA_TCD1_CITER_ELINKYES = majorLoops + 1;                           // Number of major loops to complete
-  DMA_TCD1_BITER_ELINKYES = majorLoops + 1;                           // Reset value for CITER (must be equal to CITER)
+void setupTCD1(TCD* tcd, uint32_t* source, int minorLoopSize, int majorLoops) {
+  tcd->SADDR = TCD_ADDRESS(source);                               // Address to read from
+  tcd->SOFF = 4;                                                  // Bytes to increment source register between writes 
+  tcd->ATTR = DMA_TCD_ATTR_SSIZE(2) | DMA_TCD_ATTR_DSIZE(2);      // 32-bit input and output
+  tcd->NBYTES = minorLoopSize;                                    // Number of bytes to transfer in the minor loop
+  tcd->SLAST = 0;                                                 // Bytes to add after a major iteration count (N/A)
+  tcd->DADDR = TCD_ADDRESS(&FTM0_C1V);                            // Address to write to
+  tcd->DOFF = 0;                                                  // Bytes to increment destination register between write
+  tcd->DLASTSGA = TCD_ADDRESS(tcd);                               // Address of next TCD (this one again)
 
   // Trigger DMA2 (address) after each minor loop
-  DMA_TCD1_BITER_ELINKYES |= DMA_TCD_CITER_ELINK;
-  DMA_TCD1_BITER_ELINKYES |= (0x02 << 9);  
-  DMA_TCD1_CITER_ELINKYES |= DMA_TCD_CITER_ELINK;
-  DMA_TCD1_CITER_ELINKYES |= (0x02 << 9);
+  tcd->CITER = majorLoops | DMA_TCD_CITER_ELINK | (0x02 << 9);     // Number of major loops to complete
+  tcd->BITER = majorLoops | DMA_TCD_CITER_ELINK | (0x02 << 9);     // Reset value for CITER (must be equal to CITER)
+  tcd->CSR = DMA_TCD_CSR_ESG | DMA_TCD_CSR_MAJORELINK | DMA_TCD_CSR_MAJORLINKCH(2);
 }
 
+// TCD2 writes out the address select lines, which are on port D
+void setupTCD2(TCD* tcd, uint8_t* source, int minorLoopSize, int majorLoops) {
+  tcd->SADDR = TCD_ADDRESS(source);                               // Address to read from
+  tcd->SOFF = 1;                                                  // Bytes to increment source register between writes 
+  tcd->ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);      // 8-bit input and output
+  tcd->NBYTES = minorLoopSize;                                    // Number of bytes to transfer in the minor loop
+  tcd->SLAST = 0;                                                 // Bytes to add after a major iteration count (N/A)
+  tcd->DADDR = TCD_ADDRESS(&GPIOD_PDOR);                          // Address to write to
+  tcd->DOFF = 0;                                                  // Bytes to increment destination register between write
+  tcd->DLASTSGA = TCD_ADDRESS(tcd);                               // Address of next TCD (this one again)
+
+  // Trigger DMA3 (data) after each minor loop
+  tcd->CITER = majorLoops | DMA_TCD_CITER_ELINK | (0x03 << 9);     // Number of major loops to complete
+  tcd->BITER = majorLoops | DMA_TCD_CITER_ELINK | (0x03 << 9);     // Reset value for CITER (must be equal to CITER)
+  tcd->CSR = DMA_TCD_CSR_ESG | DMA_TCD_CSR_MAJORELINK | DMA_TCD_CSR_MAJORLINKCH(3);
+}
 
+// TCD3 clocks and strobes the pixel data, which are on port C
+void setupTCD3(TCD* tcd, uint8_t* source, int minorLoopSize, int majorLoops, TCD* next) {
+  tcd->SADDR = TCD_ADDRESS(source);                               // Address to read from
+  tcd->SOFF = 1;                                                  // Bytes to increment source register between writes 
+  tcd->ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);      // 8-bit input and output
+  tcd->NBYTES = minorLoopSize;                                    // Number of bytes to transfer in the minor loop
+  tcd->SLAST = 0;                                                 // Bytes to add after a major iteration count (N/A)
+  tcd->DADDR = TCD_ADDRESS(&GPIOC_PDOR);                          // Address to write to
+  tcd->DOFF = 0;                                                  // Bytes to increment destination register between write
+  tcd->DLASTSGA = TCD_ADDRESS(next);                              // Address of next TCD
+  tcd->CITER = majorLoops;                                        // Number of major loops to complete
+  tcd->BITER = majorLoops;                                        // Reset value for CITER (must be equal to CITER)
+  tcd->CSR = DMA_TCD_CSR_ESG;                                     // No interrupt until there's a new frame (see setDataInterrupts())
+}
 
+// Copy a TCD image into one of the DMA channels
+void loadTCD(int channel, const TCD* image) {
+  volatile TCD* tcd = DMA_TCD(channel);
+
+  DMA_CDNE = DMA_CDNE_CDNE(channel);    // ESG can't be set while DONE is
+
+  tcd->SADDR = image->SADDR;
+  tcd->SOFF = image->SOFF;
+  tcd->ATTR = image->ATTR;
+  tcd->NBYTES = image->NBYTES;
+  tcd->SLAST = image->SLAST;
+  tcd->DADDR = image->DADDR;
+  tcd->DOFF = image->DOFF;
+  tcd->CITER = image->CITER;
+  tcd->DLASTSGA = image->DLASTSGA;
+  tcd->BITER = image->BITER;
+  tcd->CSR = image->CSR;                // Last, so that DLASTSGA is valid when ESG is set
+}
 
-// TCD2 writes out the address select lines, which are on port D
-void setupTCD2(uint8_t* source, int minorLoopSize, int majorLoops) {
-  DMA_TCD2_SADDR = source;                                        // Address to read from
-  DMA_TCD2_SOFF = 1;                                              // Bytes to increment source register between writes 
-  DMA_TCD2_ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);  // 8-bit input and output
-  DMA_TCD2_NBYTES_MLNO = minorLoopSize;                           // Number of bytes to transfer in the minor loop
-  DMA_TCD2_SLAST = 0;                                             // Bytes to add after a major iteration count (N/A)
-  DMA_TCD2_DADDR = &GPIOD_PDOR;                                   // Address to write to
-  DMA_TCD2_DOFF = 0;                                              // Bytes to increment destination register between write
-  DMA_TCD2_CITER_ELINKYES = majorLoops;                           // Number of major loops to complete
-  DMA_TCD2_BITER_ELINKYES = majorLoops;                           // Reset value for CITER (must be equal to CITER)
-  DMA_TCD2_DLASTSGA = 0;                                          // Address of next TCD (N/A)
-  
-  // Workaround for DMA majorelink unreliability: increase the minor loop count by one
-  // Note that the final transfer doesn't end up happening, because 
-  DMA_TCD2_CITER_ELINKYES = majorLoops;                           // Number of major loops to complete
-  DMA_TCD2_BITER_ELINKYES = majorLoops;                           // Reset value for CITER (must be equal to CITER)
-
-  // Trigger DMA3 (address) after each minor loop
-  DMA_TCD2_BITER_ELINKYES |= DMA_TCD_CITER_ELINK;
-  DMA_TCD2_BITER_ELINKYES |= (0x03 << 9);  
-  DMA_TCD2_CITER_ELINKYES |= DMA_TCD_CITER_ELINK;
-  DMA_TCD2_CITER_ELINKYES |= (0x03 << 9);
+// Turn the major loop interrupt of the pixel data TCD images on or off. It's
+// only wanted while a new frame is waiting, so that the display can refresh
+// without interrupting the CPU. The TCD that the DMA engine already loaded
+// keeps the setting it was loaded with, so there can be one more interrupt
+// after turning them off.
+void setDataInterrupts(bool enable) {
+  for(int row = 0; row < dataTCDCount; row++) {
+    if(enable) {
+      dataTCDs[row].CSR |= DMA_TCD_CSR_INTMAJOR;
+    }
+    else {
+      dataTCDs[row].CSR &= ~DMA_TCD_CSR_INTMAJOR;
+    }
+  }
 }
 
-// TCD3 clocks and strobes the pixel data, which are on port C
-void setupTCD3(uint8_t* source, int minorLoopSize, int majorLoops) {
-  DMA_TCD3_SADDR = source;                                        // Address to read from
-  DMA_TCD3_SOFF = 1;                                              // Bytes to increment source register between writes 
-  DMA_TCD3_ATTR = DMA_TCD_ATTR_SSIZE(0) | DMA_TCD_ATTR_DSIZE(0);  // 8-bit input and output
-  DMA_TCD3_NBYTES_MLNO = minorLoopSize;                           // Number of bytes to transfer in the minor loop
-  DMA_TCD3_SLAST = 0;                                             // Bytes to add after a major iteration count (N/A)
-  DMA_TCD3_DADDR = &GPIOC_PDOR;                                   // Address to write to
-  DMA_TCD3_DOFF = 0;                                              // Bytes to increment destination register between write
-  DMA_TCD3_CITER_ELINKNO = majorLoops;                            // Number of major loops to complete
-  DMA_TCD3_BITER_ELINKNO = majorLoops;                            // Reset value for CITER (must be equal to CITER)
-  DMA_TCD3_DLASTSGA = 0;                                          // Address of next TCD (N/A)
-}
-
-
-// When the last address write has completed, that means we're at the end of the display refresh cycle
-// Set up the next display frame
-void dma_ch2_isr(void) {
-  DMA_CINT = DMA_CINT_CINT(2);
-
-  if(swapBuffers) {
-    uint8_t* lastBuffer = frontBuffer;
-    frontBuffer = backBuffer;
-    backBuffer = lastBuffer;
+// Get the buffer that the DMA engine is currently sending out pixel data from
+int liveBufferIndex() {
+  const uint8_t* source = (const uint8_t*)(uintptr_t)DMA_TCD(3)->SADDR;
+  return (source - dmaBuffer[0])/PANEL_DEPTH_SIZE;
+}
+
+// A pixel data TCD finished while a new frame was waiting, and the DMA engine
+// loaded the next one. If that's from the new frame, let the frame producer
+// know, and stop the interrupts until there's another one.
+// The first part of the frame has already gone out by then: one segment in
+// row sync mode, or a whole refresh in frame sync mode.
+// Note: This is only bookkeeping; the display keeps running without it.
+void dma_ch3_isr(void) {
+  DMA_CINT = DMA_CINT_CINT(3);
+
+  int buffer = liveBufferIndex();
+
+  if(swapBuffers && (dmaBuffer[buffer] == frontBuffer)) {
     swapBuffers = false;
+    setDataInterrupts(false);
+
+    // Cached frames aren't dithered, so the errors carry on from the last
+    // frame that was
+    if(buffer < DMA_BUFFER_COUNT) {
+      ditherBuffer = buffer;
+    }
+
+    uint32_t latency = micros() - frameShowTimes[buffer];
+
+    displayStats.framesPresented++;
+    displayStats.lastLatency = latency;
+    if(latency > displayStats.maxLatency) {
+      displayStats.maxLatency = latency;
+    }
+
+    if(framePresentedCallback != NULL) {
+      framePresentedCallback(frameNumbers[buffer]);
+    }
   }
-  
-  setupTCDs();
 }
 
+// Build the TCD images for the current buffers and mode, and (re)start the
+// DMA engine with them.
 void setupTCDs() {
-  setupTCD0(FTM0_MODStates, 4,                        BIT_DEPTH*LED_ROWS);
-  setupTCD1(FTM0_C1VStates, 4,                        BIT_DEPTH*LED_ROWS);
-  setupTCD2(Addresses,      ADDRESS_REPEAT_COUNT, BIT_DEPTH*LED_ROWS);
-  setupTCD3(frontBuffer,    ROW_BIT_SIZE,             BIT_DEPTH*LED_ROWS);
+  DMA_CERQ = DMA_CERQ_CERQ(0);          // Hold off timer requests while the TCDs are rewritten
+
+  setupTCD0(&timerTCD,  FTM0_MODStates, 4,                    rowSlots*LED_ROWS);
+  setupTCD1(&onTimeTCD, FTM0_C1VStates, 4,                    rowSlots*LED_ROWS);
+  setupTCD2(&addressTCD, Addresses,     ADDRESS_REPEAT_COUNT, rowSlots*LED_ROWS);
 
+  if(rowSync) {
+    // One image per segment, chained in a ring
+    for(int row = 0; row < LED_ROWS; row++) {
+      setupTCD3(&dataTCDs[row], frontBuffer + row*SEGMENT_SIZE, ROW_BIT_SIZE, rowSlots,
+                &dataTCDs[(row + 1)%LED_ROWS]);
+    }
+    dataTCDCount = LED_ROWS;
+  }
+  else {
+    // One image for the whole panel
+    setupTCD3(&dataTCDs[0], frontBuffer, ROW_BIT_SIZE, rowSlots*LED_ROWS, &dataTCDs[0]);
+    dataTCDCount = 1;
+  }
+
+  // The front buffer goes straight on the display, but it still has to be
+  // reported
+  setDataInterrupts(swapBuffers);
+
+  loadTCD(0, &timerTCD);
+  loadTCD(1, &onTimeTCD);
+  loadTCD(2, &addressTCD);
+  loadTCD(3, &dataTCDs[0]);
+
+  // Send out the first block of data, so that it's ready for the first timer cycle
   DMA_SSRT = DMA_SSRT_SSRT(3);
+
+  DMA_SERQ = DMA_SERQ_SERQ(0);
 }
 
 
@@ -29,7 +29,14 @@
 #include "blinkypendant.h"
 
 //Display Geometry
-#define BIT_DEPTH 8       // Color bits per channel (Note: input is always 8 bit)
+#define MAX_BIT_DEPTH 8   // Color bits per channel (Note: input is always 8 bit)
+
+// Encoded frames kept for prepareCached() (720 bytes of RAM each). This is
+// the fewest that works, since the display can be using two of them. A POV
+// stroke covers far more frames than could be kept, so only the ones either
+// side of a turnaround come back while they're still cached, and each extra
+// slot only adds a frame or so per stroke.
+#define FRAME_CACHE_SLOTS 3
 
 // Output assignments
 // Note: These can't be changed arbitrarily- the GPIOs are actually
@@ -48,32 +55,189 @@ struct Pixel {
   uint8_t B;
 };
 
+// Counts of frames handed to show(), for checking that the producer keeps up
+struct DisplayStats {
+  uint32_t framesPresented;   // Frames that made it to the display
+  uint32_t framesDropped;     // Frames that were discarded before being displayed
+  uint32_t lastLatency;       // Time from show() to display of the last frame, in us
+  uint32_t maxLatency;        // Longest time from show() to display, in us
+};
+
+// Counts of frame cache lookups
+struct FrameCacheStats {
+  uint32_t hits;              // Frames prepared straight from the cache
+  uint32_t misses;            // Frames that had to be encoded
+};
+
+// Called from the display interrupt when a new frame starts being displayed
+// @param frame Frame number, as returned by show()
+typedef void (*FramePresentedCallback)(uint32_t frame);
+
 // Set up the matrix and start running it's display loop
 extern void matrixSetup();
 
 // Re-start a paused matrix
 extern void matrixStart();
 
+// Blank the display and stop refreshing it, to save power. Call
+// matrixSetup() to start it again.
+extern void matrixStop();
+
 // Change the system brightness
+// Pixel values are gamma corrected using brightnessTable, then scaled by the
+// system brightness and the white balance before being displayed.
 // @param brightness Display brightness scale, from 0 (off) to 1 (fully on)
 extern void setBrightness(float brightness);
 
+// Turn temporal dithering on or off
+// The gamma corrected colors have more resolution than the display can show;
+// with dithering on, the extra bits are spread over successive refreshes.
+// This needs show() to be called continuously to have any effect.
+// Frames from prepareFrom() and the frame cache (the POV frames) are
+// deliberately left undithered: dithering means encoding a frame again for
+// every refresh, which is the work that they're there to save.
+// @param enable If true, dither the display
+extern void setDithering(bool enable);
+
+// Change the white balance
+// @param r Red channel scale, from 0 (off) to 255 (fully on)
+// @param g Green channel scale, from 0 (off) to 255 (fully on)
+// @param b Blue channel scale, from 0 (off) to 255 (fully on)
+extern void setWhiteBalance(uint8_t r, uint8_t g, uint8_t b);
+
 // Update a single pixel in the array
 // @param column int Pixel column (0 to LED_COLS - 1)
 // @param row int Pixel row (0 to LED_ROWS - 1)
 // @param value uint8_t New value for the pixel (0 - 255)
 extern void setPixel(int column, int row, uint8_t r, uint8_t g, uint8_t b);
 
+// Copy a whole frame into the pixels, like setPixel() on each of them, so
+// that only the channels that changed are re-encoded
+// @param frame LED_COUNT pixels, in the same order as the pixels array
+extern void setPixels(const Pixel* frame);
+
 // Update the matrix using the data in the Pixels[] array
-extern void show();
+// Only the channels changed by setPixel() since the last update are re-encoded.
+// @return Frame number of the new frame, or 0 if it was dropped
+extern uint32_t show();
+
+// Encode the pixels into a spare buffer like show(), but don't hand the
+// frame to the display until present() is called. This splits the slow part
+// of show() from the part that has to happen at a precise time, so that a
+// timer interrupt can put the frame up on schedule.
+// Note: show() throws away a prepared frame that hasn't been presented yet.
+// @return Frame number of the prepared frame
+extern uint32_t prepare();
+
+// Like prepare(), but encode a frame straight from where it already is
+// (for example, an RGB24 animation frame in flash) instead of the pixels.
+// The frame isn't dithered, and the pixels are left alone; the next show()
+// or prepare() encodes them in full.
+// @param frame LED_COUNT pixels, in the same order as the pixels array
+// @return Frame number of the prepared frame
+extern uint32_t prepareFrom(const Pixel* frame);
+
+// Hand the frame from the last prepare() to the display. It replaces a frame
+// that's still waiting, whether or not triple buffering is on. This can be
+// called from an interrupt.
+// @return false if there wasn't a prepared frame (or it was still being
+// encoded)
+extern bool present();
+
+// Frame cache
+// A frame that's going to be shown again and again (like a POV column, on
+// every stroke) can be kept once it's encoded. After that it's handed to the
+// display as it is, without touching the pixels. Cached frames aren't
+// dithered (see setDithering()), and the cache is emptied whenever the encoding changes
+// (brightness, white balance, bit depth or plane interleaving).
+
+// Prepare a cached frame for present(), in place of prepare()
+// @param key Caller's name for the frame, for example its animation frame number
+// @return false if the frame isn't cached; then set the pixels, and call
+// prepareAndCache()
+extern bool prepareCached(uint32_t key);
+
+// Like prepare(), but also keep the frame in the cache, in place of the
+// least recently used one
+// @param key Caller's name for the frame
+// @return Frame number of the prepared frame
+extern uint32_t prepareAndCache(uint32_t key);
+
+// Like prepareAndCache(), but encode a frame straight from where it is,
+// like prepareFrom()
+// @param key Caller's name for the frame
+// @param frame LED_COUNT pixels, in the same order as the pixels array
+// @return Frame number of the prepared frame
+extern uint32_t prepareAndCacheFrom(uint32_t key, const Pixel* frame);
+
+// Forget all cached frames (for example when the animation changes)
+extern void clearFrameCache();
+
+// Get the number of cache hits and misses, since startup or the last clear
+extern FrameCacheStats getFrameCacheStats();
+
+// Start counting cache hits and misses again
+extern void clearFrameCacheStats();
+
+// Choose what happens when show() is called before the last frame was displayed
+// @param enable If true, the new frame replaces the waiting one (the latest
+// frame always wins). If false, the new frame is dropped.
+extern void setTripleBuffering(bool enable);
+
+// Change the number of bit planes that are displayed for each color channel.
+// Fewer bit planes give a higher refresh rate, at the cost of color resolution.
+// Note: This restarts the display, so it shouldn't be changed on every frame.
+// @param depth Bits per channel, from 1 to MAX_BIT_DEPTH
+extern void setBitDepth(int depth);
+
+// Get the number of bit planes that are displayed for each color channel
+extern int getBitDepth();
+
+// Get the display refresh rate for the current bit depth
+// @return Refresh rate, in Hz
+extern uint32_t getRefreshRate();
+
+// Choose the order that the bit planes are displayed in
+// Normally each row shows all of its planes in turn, so the most significant
+// plane is one long block of light. With interleaving, the longest planes are
+// split into equal slices that are spread through the refresh and alternated
+// between the rows, which reduces color breakup when the display is moving.
+// This costs a slightly lower refresh rate.
+// Note: This restarts the display, so it shouldn't be changed on every frame.
+// @param enable If true, interleave the bit planes
+extern void setPlaneInterleaving(bool enable);
+
+// Choose when a new frame can start being displayed
+// Note: This restarts the display, so it shouldn't be changed on every frame.
+// @param enable If true, new frames are picked up at the next row boundary
+// (or half way through a refresh, when the bit planes are interleaved).
+// If false, new frames are only picked up at the end of a full refresh.
+extern void setRowSync(bool enable);
+
+// Turn the display upside down (rotate it 180 degrees), for a pendant that's
+// hanging the wrong way up. The pixels keep their coordinates; only the
+// encoding changes, so the next show() re-encodes everything.
+// @param enable If true, show column 0, row 0 at the opposite corner
+extern void setFlipped(bool enable);
+
+// @return true if the display is upside down
+extern bool getFlipped();
+
+// Register a function to be called when a frame starts being displayed
+// @param callback Function to call from the display interrupt, or NULL for none
+extern void setFramePresentedCallback(FramePresentedCallback callback);
+
+// Get the number of frames presented and dropped since startup
+extern DisplayStats getDisplayStats();
 
 // Get the display pixel buffer
+// Note: This marks every pixel as changed, so the next show() does a full update.
 // @return Pointer to the pixel display buffer, a uint8_t array of size
 // LED_ROWS*LED_COLS
 // TODO: Change to pixel type...
 extern Pixel* getPixels();
 
-// The display is double-buffered internally. This function returns
+// The display is triple-buffered internally. This function returns
 // true if there is already an update waiting.
 extern bool bufferWaiting();
 
@@ -3,6 +3,7 @@
 #include "core_pins.h"
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #define MMA8653_ADDRESS    0x1D
 
@@ -44,6 +45,14 @@
 #define XYZ_DATA_CFG_4G    0x01
 #define XYZ_DATA_CFG_8G    0x02
 
+#define PL_STATUS_LO       0x40                            // Z-tilt lockout (lying flat, orientation unknown)
+#define PL_STATUS_LAPO(n)  (((n) >> 1) & 0x03)             // Orientation
+
+#define PL_CFG_DBCNTM      0x80                            // Debounce counter clears, rather than counting down, when the orientation doesn't hold
+#define PL_CFG_PL_EN       0x40                            // Orientation detection enable
+
+#define PL_COUNT_DEBOUNCE  200                             // Samples the orientation has to hold for (0.25s at 800Hz)
+
 #define CTRL_REG1_ACTIVE   0x01                            // Full-scale selection
 #define CTRL_REG1_F_READ   0x02                            // Fast Read Mode
 #define CTRL_REG1_DR(n)    (uint8_t)(((n) & 0x07) << 3)    // Data rate selection
@@ -55,6 +64,19 @@
 #define CTRL_REG2_SLPE     0x02                            // Auto-SLEEP enable
 #define CTRL_REG2_MODS(n)  (uint8_t)(((n) & 0x03))         // ACTIVE mode power scheme selection
 
+#define FF_MT_CFG_ELE      0x80                            // Event latch enable
+#define FF_MT_CFG_OAE      0x40                            // Motion detect (any axis over), rather than freefall (all axes under)
+#define FF_MT_CFG_ZEFE     0x20                            // Event flag enable on Z
+#define FF_MT_CFG_YEFE     0x10                            // Event flag enable on Y
+#define FF_MT_CFG_XEFE     0x08                            // Event flag enable on X
+
+#define FF_MT_THS_STEP     40141                           // Threshold step, 1/16g (0.063g), in m/s^2 (Q16.16)
+#define FF_MT_THS_MAX      127
+
+#define CTRL_REG1_ASLP_RATE_1HZ 3                          // 1.56Hz auto-sleep sample rate
+
+#define CTRL_REG2_MODS_LOW_POWER 3                         // Low power oversampling, in CTRL_REG2_MODS and SMODS
+
 #define CTRL_REG3_PP_OD         0x01
 #define CTRL_REG3_IPOL          0x02
 #define CTRL_REG3_WAKE_FF_MT    0x08
@@ -74,7 +96,7 @@ class WIRE {
 private:
     int remaining;
 public:
-    void begin();
+    void begin(uint32_t busSpeed);
     void beginTransmission(uint8_t address);
     void endTransmission(bool stop);
     void write(uint8_t data);
@@ -83,10 +105,33 @@ public:
     bool available();
 };
 
-void WIRE::begin() {
+// SCL divider for each I2C_F ICR setting (MULT = 1), from the K20 reference manual
+static const uint16_t sclDividers[64] = {
+      20,   22,   24,   26,   28,   30,   34,   40,   28,   32,   36,   40,   44,   48,   56,   68,
+      48,   56,   64,   72,   80,   88,  104,  128,   80,   96,  112,  128,  144,  160,  192,  240,
+     160,  192,  224,  256,  288,  320,  384,  480,  320,  384,  448,  512,  576,  640,  768,  960,
+     640,  768,  896, 1024, 1152, 1280, 1536, 1920, 1280, 1536, 1792, 2048, 2304, 2560, 3072, 3840
+};
+
+// Find the ICR setting for the fastest clock that isn't over busSpeed
+static uint8_t frequencyDivider(uint32_t busSpeed) {
+    if(busSpeed > MMA8653_BUS_SPEED) {
+        busSpeed = MMA8653_BUS_SPEED;
+    }
+
+    uint8_t best = 63;
+    for(uint8_t icr = 0; icr < 64; icr++) {
+        if(sclDividers[icr]*busSpeed >= F_BUS && sclDividers[icr] < sclDividers[best]) {
+            best = icr;
+        }
+    }
+    return best;
+}
+
+void WIRE::begin(uint32_t busSpeed) {
     SIM_SCGC4 |= SIM_SCGC4_I2C0;    // Enable the I2C0 clock
     
-    I2C0_F = 0x1B;                  // Set transmission speed (100KHz?)
+    I2C0_F = frequencyDivider(busSpeed);    // Set transmission speed (MULT = 1)
     I2C0_C1 = I2C_C1_IICEN;         // Enable I2C
 
     // TODO: Set pin muxes!
@@ -171,9 +216,154 @@ bool WIRE::available() {
 WIRE Wire;
 
 
-void MMA8653::setup() {
-  // Set up the SPI peripheral
-  Wire.begin();
+// Background reads: the data ready interrupt starts a burst read of the
+// status and output registers, and the I2C0 interrupt moves it along one
+// byte at a time, so the CPU never waits on the bus. The orientation is read
+// the same way, a byte from PL_STATUS.
+enum ReadState {
+    READ_IDLE,
+    READ_SEND_REGISTER,     // Device address (write) is going out, register address next
+    READ_RESTART,           // Register address is going out, repeated start next
+    READ_START_RECEIVE,     // Device address (read) is going out, switch to receive next
+    READ_RECEIVE,           // Receiving data
+};
+
+// A read starts at STATUS, then gets OUT_X_MSB, OUT_Y_MSB and OUT_Z_MSB in
+// fast read mode, or all six output registers otherwise
+#define READ_LENGTH_FAST    4
+#define READ_LENGTH_FULL    7
+
+static volatile uint8_t readState = READ_IDLE;
+static uint8_t readBuffer[READ_LENGTH_FULL];
+static uint8_t readCount;
+static uint8_t readRegister;        // Register the running read starts at
+static uint8_t transferLength;      // Bytes in the running read
+static MMA8653* readDevice;
+static MMA8653::SampleCallback readCallback;
+static MMA8653::OrientationCallback orientationCallback;
+
+// Settings the output registers are read and scaled with
+static uint8_t readLength = READ_LENGTH_FAST;
+static uint8_t readRange = MMA8653_RANGE_8G;
+
+// Decode the output registers (everything after STATUS) into acceleration
+static void decodeOutput(const uint8_t* output, int32_t& X, int32_t& Y, int32_t& Z) {
+    if(readLength == READ_LENGTH_FULL) {
+        X = MMA8653::toAcceleration(output[0] << 8 | output[1], readRange);
+        Y = MMA8653::toAcceleration(output[2] << 8 | output[3], readRange);
+        Z = MMA8653::toAcceleration(output[4] << 8 | output[5], readRange);
+    }
+    else {
+        X = MMA8653::toAcceleration(output[0] << 8, readRange);
+        Y = MMA8653::toAcceleration(output[1] << 8, readRange);
+        Z = MMA8653::toAcceleration(output[2] << 8, readRange);
+    }
+}
+
+// Send a stop, and give up on the read
+static void abortRead() {
+    I2C0_C1 &= ~(I2C_C1_MST | I2C_C1_TX | I2C_C1_TXAK | I2C_C1_IICIE);
+    readState = READ_IDLE;
+    readDevice->errorCount++;
+}
+
+extern "C" void i2c0_isr(void) {
+    uint8_t status = I2C0_S;
+    I2C0_S = I2C_S_IICIF | I2C_S_ARBL;
+
+    if(status & I2C_S_ARBL) {
+        abortRead();
+        return;
+    }
+
+    switch(readState) {
+    case READ_SEND_REGISTER:
+        if(status & I2C_S_RXAK) {
+            abortRead();
+            break;
+        }
+        I2C0_D = readRegister;
+        readState = READ_RESTART;
+        break;
+
+    case READ_RESTART:
+        if(status & I2C_S_RXAK) {
+            abortRead();
+            break;
+        }
+        I2C0_C1 |= I2C_C1_RSTA;
+        I2C0_D = MMA8653_ADDRESS << 1 | 0x01;
+        readState = READ_START_RECEIVE;
+        break;
+
+    case READ_START_RECEIVE:
+        if(status & I2C_S_RXAK) {
+            abortRead();
+            break;
+        }
+        I2C0_C1 &= ~(I2C_C1_TX);    // Switch to receive, and read D to clock in the first byte
+        if(transferLength == 1) {
+            I2C0_C1 |= I2C_C1_TXAK; // The first byte is the last one, so don't ACK it
+        }
+        readCount = 0;
+        readState = READ_RECEIVE;
+        (void)I2C0_D;
+        break;
+
+    case READ_RECEIVE:
+        if(readCount == transferLength - 2) {
+            I2C0_C1 |= I2C_C1_TXAK;     // Don't ACK the last byte
+        }
+        else if(readCount == transferLength - 1) {
+            // Send the stop before reading D, so that no more bytes get clocked in
+            I2C0_C1 &= ~(I2C_C1_MST | I2C_C1_TXAK | I2C_C1_IICIE);
+        }
+
+        readBuffer[readCount++] = I2C0_D;
+
+        if(readCount == transferLength) {
+            // Let the stop finish, so that the callback can start another read
+            while(I2C0_S & I2C_S_BUSY) {}
+            readState = READ_IDLE;
+
+            if(readRegister == STATUS) {
+                int32_t X, Y, Z;
+                decodeOutput(readBuffer + 1, X, Y, Z);
+                readCallback(X, Y, Z);
+            }
+            else if(readBuffer[0] & PL_STATUS_LO) {
+                orientationCallback(MMA8653_ORIENTATION_UNKNOWN);
+            }
+            else {
+                orientationCallback(PL_STATUS_LAPO(readBuffer[0]));
+            }
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+void MMA8653::setup(uint8_t range, uint8_t rate, bool highResolution, uint32_t busSpeed) {
+  busyCount = 0;
+  errorCount = 0;
+
+  // Set up the I2C peripheral
+  Wire.begin(busSpeed);
+
+  // After sleep(), a motion event can be holding the interrupt pin low.
+  // Reading the event source lets it go (and the reset turns the motion
+  // detector off).
+  Wire.beginTransmission(MMA8653_ADDRESS);
+  Wire.write(FF_MT_SRC);
+  Wire.endTransmission(false);
+
+  Wire.requestFrom(MMA8653_ADDRESS, 1);
+  while(Wire.available()) {
+    Wire.receive();
+  }
   
   // Reset the device, to put it into a known state.
   Wire.beginTransmission(MMA8653_ADDRESS);
@@ -194,55 +384,202 @@ void MMA8653::setup() {
     // TODO: Test if this is equal to 0x5A?
   }
 
-  // Configure for 8G sensitivity
+  // Configure the range
+  readRange = range;
   Wire.beginTransmission(MMA8653_ADDRESS);
   Wire.write(XYZ_DATA_CFG);
-  Wire.write(XYZ_DATA_CFG_8G);
+  Wire.write(range & 0x03);
   Wire.endTransmission();
 
 
-  // Enable data ready interrupt on interrput pin 1
+  // Detect the orientation, with the default trip angles
+  Wire.beginTransmission(MMA8653_ADDRESS);
+  Wire.write(PL_CFG);
+  Wire.write(PL_CFG_DBCNTM | PL_CFG_PL_EN);
+  Wire.endTransmission();
+
+  Wire.beginTransmission(MMA8653_ADDRESS);
+  Wire.write(PL_COUNT);
+  Wire.write(PL_COUNT_DEBOUNCE);
+  Wire.endTransmission();
+
+  // Enable the data ready and orientation interrupts on interrput pin 1
   Wire.beginTransmission(MMA8653_ADDRESS);
   Wire.write(CTRL_REG4);
-  Wire.write(CTRL_REG4_INT_EN_DRDY);
+  Wire.write(CTRL_REG4_INT_EN_DRDY | CTRL_REG4_INT_EN_LNDPRT);
   Wire.endTransmission();
 
   Wire.beginTransmission(MMA8653_ADDRESS);
   Wire.write(CTRL_REG5);
-  Wire.write(CTRL_REG5_INT_CFG_DRDY);
+  Wire.write(CTRL_REG5_INT_CFG_DRDY | CTRL_REG5_INT_CFG_LNDPRT);
   Wire.endTransmission();
 
-  // Put in fast-read mode, with 800Hz output rate, and activate
+  // Set the output rate and read mode, and activate
+  readLength = highResolution ? READ_LENGTH_FULL : READ_LENGTH_FAST;
   Wire.beginTransmission(MMA8653_ADDRESS);
   Wire.write(CTRL_REG1);
-  Wire.write(CTRL_REG1_ACTIVE | CTRL_REG1_F_READ | CTRL_REG1_DR(0));
+  Wire.write(CTRL_REG1_ACTIVE | (highResolution ? 0 : CTRL_REG1_F_READ) | CTRL_REG1_DR(rate));
   Wire.endTransmission();
-}
 
-bool MMA8653::getXYZ(float& X, float& Y, float& Z) {
+  // Background reads come in below the display interrupts, but above the
+  // data ready interrupt that starts them
+  NVIC_SET_PRIORITY(IRQ_I2C0, 224);
+  NVIC_ENABLE_IRQ(IRQ_I2C0);
+}
 
-    // TODO: We're assuming that we are in 8G, 8 bit mode
-    // 1/16*9.8m/s^2
-#define factor (.6125)
+bool MMA8653::getXYZ(int32_t& X, int32_t& Y, int32_t& Z) {
+    // Don't get in the way of a background read
+    if(readState != READ_IDLE) {
+        return false;
+    }
 
     Wire.beginTransmission(MMA8653_ADDRESS);
     Wire.write(STATUS);
     Wire.endTransmission(false);
     
-    Wire.requestFrom(MMA8653_ADDRESS, 4);
- 
-    if(Wire.available()) {
-        Wire.receive();
+    Wire.requestFrom(MMA8653_ADDRESS, readLength);
+
+    uint8_t data[READ_LENGTH_FULL];
+    for(int i = 0; i < readLength; i++) {
+        if(!Wire.available()) {
+            return false;
+        }
+        data[i] = Wire.receive();
     }
-    if(Wire.available()) {
-        X = factor*(int8_t)Wire.receive();
+
+    decodeOutput(data + 1, X, Y, Z);
+
+    return true;
+}
+
+bool MMA8653::busy() {
+    return readState != READ_IDLE || (I2C0_S & I2C_S_BUSY);
+}
+
+// Longest to wait for a byte to finish going over the bus, in us (a byte
+// and its ACK take 90us at 100KHz)
+#define STOP_WAIT_US 200
+
+bool MMA8653::stopReads() {
+    NVIC_DISABLE_IRQ(IRQ_I2C0);
+
+    if(readState != READ_IDLE) {
+        // Let the byte that's on the bus finish, then send a stop
+        for(int us = 0; us < STOP_WAIT_US && !(I2C0_S & I2C_S_IICIF); us++) {
+            delayMicroseconds(1);
+        }
+        I2C0_C1 &= ~(I2C_C1_MST | I2C_C1_TX | I2C_C1_TXAK | I2C_C1_IICIE);
+        I2C0_S = I2C_S_IICIF;
+        readState = READ_IDLE;
     }
-    if(Wire.available()) {
-        Y = factor*(int8_t)Wire.receive();
+
+    for(int us = 0; us < STOP_WAIT_US && (I2C0_S & I2C_S_BUSY); us++) {
+        delayMicroseconds(1);
+    }
+    return !(I2C0_S & I2C_S_BUSY);
+}
+
+// Start a background read
+static void startTransfer(uint8_t address, uint8_t length) {
+    readRegister = address;
+    transferLength = length;
+    readState = READ_SEND_REGISTER;
+
+    // Start condition, and the device address; the rest happens in i2c0_isr()
+    I2C0_S = I2C_S_IICIF;
+    I2C0_C1 = I2C_C1_IICEN | I2C_C1_IICIE | I2C_C1_MST | I2C_C1_TX;
+    I2C0_D = MMA8653_ADDRESS << 1;
+}
+
+bool MMA8653::startRead(SampleCallback callback) {
+    if(busy()) {
+        busyCount++;
+        return false;
     }
-    if(Wire.available()) {
-        Z = factor*(int8_t)Wire.receive();
+
+    readDevice = this;
+    readCallback = callback;
+    startTransfer(STATUS, readLength);
+    return true;
+}
+
+bool MMA8653::startOrientationRead(OrientationCallback callback) {
+    if(busy()) {
+        busyCount++;
+        return false;
     }
 
+    readDevice = this;
+    orientationCallback = callback;
+    startTransfer(PL_STATUS, 1);
     return true;
 }
+
+// Gravity can sit up to 0.5g on an axis that is still watched for motion,
+// and the pendant has to move 0.25g past where it was resting to wake up
+#define WAKE_AXIS_LIMIT     (8*FF_MT_THS_STEP)
+#define WAKE_MARGIN         (4*FF_MT_THS_STEP)
+
+// Wake sample rate, and debounce (samples)
+#define WAKE_RATE           MMA8653_RATE_12HZ
+#define WAKE_COUNT          1
+
+// Time without motion before dropping to the auto-sleep rate (0.32s steps)
+#define WAKE_ASLP_COUNT     1
+
+static void writeRegister(uint8_t address, uint8_t value) {
+    Wire.beginTransmission(MMA8653_ADDRESS);
+    Wire.write(address);
+    Wire.write(value);
+    Wire.endTransmission();
+}
+
+void MMA8653::sleep(const int32_t rest[3]) {
+    static const uint8_t axisEnables[3] = {FF_MT_CFG_XEFE, FF_MT_CFG_YEFE, FF_MT_CFG_ZEFE};
+
+    // Watch the axes that gravity isn't on, and always at least the one
+    // furthest from it. One threshold covers them all, so it has to clear
+    // the biggest resting value.
+    int quietest = 0;
+    for(int axis = 1; axis < 3; axis++) {
+        if(abs(rest[axis]) < abs(rest[quietest])) {
+            quietest = axis;
+        }
+    }
+
+    uint8_t enables = 0;
+    int32_t largest = 0;
+    for(int axis = 0; axis < 3; axis++) {
+        if(axis == quietest || abs(rest[axis]) < WAKE_AXIS_LIMIT) {
+            enables |= axisEnables[axis];
+            if(abs(rest[axis]) > largest) {
+                largest = abs(rest[axis]);
+            }
+        }
+    }
+
+    int32_t threshold = (largest + WAKE_MARGIN + FF_MT_THS_STEP - 1)/FF_MT_THS_STEP;
+    if(threshold > FF_MT_THS_MAX) {
+        threshold = FF_MT_THS_MAX;
+    }
+
+    // The settings can only be changed in standby
+    writeRegister(CTRL_REG1, 0);
+
+    writeRegister(FF_MT_CFG, FF_MT_CFG_OAE | enables);
+    writeRegister(FF_MT_THS, threshold);
+    writeRegister(FF_MT_COUNT, WAKE_COUNT);
+
+    // Motion is the only thing that keeps it awake, or wakes it up again
+    writeRegister(ASLP_COUNT, WAKE_ASLP_COUNT);
+    writeRegister(CTRL_REG2, CTRL_REG2_SLPE | CTRL_REG2_SMODS(CTRL_REG2_MODS_LOW_POWER)
+                             | CTRL_REG2_MODS(CTRL_REG2_MODS_LOW_POWER));
+    writeRegister(CTRL_REG3, CTRL_REG3_WAKE_FF_MT);
+
+    // Motion, instead of data ready, on interrupt pin 1
+    writeRegister(CTRL_REG4, CTRL_REG4_INT_EN_FF_MT);
+    writeRegister(CTRL_REG5, CTRL_REG5_INT_CFG_FF_MT);
+
+    writeRegister(CTRL_REG1, CTRL_REG1_ACTIVE | CTRL_REG1_DR(WAKE_RATE)
+                             | CTRL_REG1_ASLP_RATE(CTRL_REG1_ASLP_RATE_1HZ));
+}
@@ -1,10 +1,105 @@
 #ifndef MMA8653_H_
 #define MMA8653_H_
 
+#include <stdint.h>
+
+#define MMA8653_FRACTION_BITS 16    // getXYZ() returns acceleration in Q16.16 fixed point
+
+#define MMA8653_BUS_SPEED 400000    // Default I2C clock rate (Hz); the part supports up to 400KHz fast mode
+
+// Full scale ranges (XYZ_DATA_CFG)
+#define MMA8653_RANGE_2G    0
+#define MMA8653_RANGE_4G    1
+#define MMA8653_RANGE_8G    2
+
+// Output data rates (CTRL_REG1_DR)
+#define MMA8653_RATE_800HZ  0
+#define MMA8653_RATE_400HZ  1
+#define MMA8653_RATE_200HZ  2
+#define MMA8653_RATE_100HZ  3
+#define MMA8653_RATE_50HZ   4
+#define MMA8653_RATE_12HZ   5       // 12.5Hz
+#define MMA8653_RATE_6HZ    6       // 6.25Hz
+#define MMA8653_RATE_1HZ    7       // 1.56Hz
+
+// Orientations, from the portrait/landscape detector (PL_STATUS LAPO). In
+// portrait up, Y reads -1g.
+#define MMA8653_PORTRAIT_UP         0
+#define MMA8653_PORTRAIT_DOWN       1
+#define MMA8653_LANDSCAPE_RIGHT     2
+#define MMA8653_LANDSCAPE_LEFT      3
+#define MMA8653_ORIENTATION_UNKNOWN 4   // Lying too flat to tell
+
 class MMA8653 {
 public:
-    void setup();
-    bool getXYZ(float& X, float& Y, float& Z);
+    // Called from the I2C interrupt when a background read has finished
+    // @param X, Y, Z Acceleration on each axis, in m/s^2 (Q16.16)
+    typedef void (*SampleCallback)(int32_t X, int32_t Y, int32_t Z);
+
+    // Called from the I2C interrupt when a background orientation read has finished
+    // @param orientation MMA8653_PORTRAIT_UP, ...
+    typedef void (*OrientationCallback)(uint8_t orientation);
+
+    uint32_t busyCount;     // Reads that couldn't start, because the last one was still running
+    uint32_t errorCount;    // Reads that weren't acknowledged by the accelerometer
+
+    // @param range Full scale range (MMA8653_RANGE_2G, 4G or 8G)
+    // @param rate Output data rate (MMA8653_RATE_800HZ, ...), which is also
+    //        the rate of the data ready interrupt. The orientation
+    //        interrupt shares the pin, and holds it low until the
+    //        orientation is read.
+    // @param highResolution If true, read all 10 bits of each axis. If false,
+    //        use fast read mode, which only reads the 8 most significant.
+    // @param busSpeed I2C clock rate, in Hz (up to 400000). The closest
+    //        rate that the I2C clock divider can make, without going over,
+    //        is used.
+    void setup(uint8_t range = MMA8653_RANGE_8G, uint8_t rate = MMA8653_RATE_800HZ,
+               bool highResolution = true, uint32_t busSpeed = MMA8653_BUS_SPEED);
+
+    // Read the current acceleration, waiting for the transfer to finish
+    // @param X, Y, Z Acceleration on each axis, in m/s^2 (Q16.16)
+    bool getXYZ(int32_t& X, int32_t& Y, int32_t& Z);
+
+    // Start reading the current acceleration in the background. This only
+    // kicks off the I2C transfer, so it's safe to call from an interrupt;
+    // the I2C interrupt runs the rest of it a byte at a time.
+    // @param callback Function to call with the sample, once it's been read
+    // @return false if a read was already running (the sample is skipped)
+    bool startRead(SampleCallback callback);
+
+    // Start reading the orientation in the background, like startRead(). This
+    // clears the orientation interrupt.
+    // @param callback Function to call with the orientation, once it's been read
+    // @return false if a read was already running
+    bool startOrientationRead(OrientationCallback callback);
+
+    // @return true if startRead() would have to skip a sample right now
+    bool busy();
+
+    // Stop background reads, and keep new ones from getting anywhere, until
+    // setup(). While the interrupt pin is held low, each read that finishes
+    // can start another, so busy() may never clear on its own.
+    // @return false if the bus was still busy after waiting for it
+    bool stopReads();
+
+    // Put the accelerometer in a low power mode where it only watches for
+    // motion, and pulls the interrupt pin when the pendant moves. It falls
+    // back to its slowest rate (auto-sleep) until something happens. Call
+    // stopReads() first, and setup() to start taking samples again.
+    // The motion detector works on the raw acceleration, gravity included,
+    // so the axes that gravity is on are left out.
+    // @param rest Acceleration with the pendant at rest, on each axis (m/s^2, Q16.16)
+    void sleep(const int32_t rest[3]);
+
+    // Convert an output register value to acceleration
+    // @param output OUT_n_MSB:OUT_n_LSB, as a left justified 16 bit value
+    // @param range Full scale range the value was read at
+    // @return Acceleration, in m/s^2 (Q16.16)
+    static int32_t toAcceleration(int16_t output, uint8_t range) {
+        // 1G (9.8m/s^2) is 16384 at 2G, halving with each step up in range.
+        // 9.8/1024 in Q16.16 is 627.2, so use 40141 (9.8/16) and shift.
+        return ((int32_t)output*40141) >> (10 - range);
+    }
 };
 
 #endif
@@ -0,0 +1,66 @@
+#include "WProgram.h"
+#include "parameters.h"
+#include "dfu.h"
+
+#define PARAMETERS_START ((const uint8_t*)0xA000 + PARAMETERS_BLOCK*DFU_TRANSFER_SIZE)
+
+#define PARAMETERS_MAGIC 0x5650 // "PV", little endian
+
+// What's stored in the sector. The size of the parameters doubles as their
+// version, so that a block saved by firmware with a different layout isn't
+// read back wrong.
+struct ParameterBlock {
+    uint16_t magic;
+    uint16_t size;
+    POVParameters pov;
+};
+
+bool loadParameters(POVParameters& parameters) {
+    const ParameterBlock* block = (const ParameterBlock*)PARAMETERS_START;
+
+    // Erased flash reads as 0xFF
+    if(block->magic != PARAMETERS_MAGIC || block->size != sizeof(POVParameters)) {
+        return false;
+    }
+
+    parameters = block->pov;
+    return true;
+}
+
+// This has to run from RAM, since the flash can't be read while it's being
+// written (see doWrite() in serialloop.cpp)
+RAM_FUNCTION static bool writeBlock(ParameterBlock* block) {
+    bool result = false;
+
+    __disable_irq();
+
+    // The DFU download erases and programs the sector once it has the
+    // whole block
+    if(dfu_download(PARAMETERS_BLOCK, sizeof(*block), 0, sizeof(*block), (const uint8_t*)block)) {
+        uint8_t status[6];
+        do {
+            dfu_getstatus(status);
+        }
+        while((status[0] == OK)
+              && (status[4] != dfuDNLOAD_IDLE)
+              && (status[4] != dfuIDLE));
+
+        result = (status[0] == OK);
+        if(!result) {
+            dfu_clrstatus();
+        }
+    }
+
+    __enable_irq();
+
+    return result;
+}
+
+bool saveParameters(const POVParameters& parameters) {
+    ParameterBlock block;
+    block.magic = PARAMETERS_MAGIC;
+    block.size = sizeof(POVParameters);
+    block.pov = parameters;
+
+    return writeBlock(&block);
+}
@@ -0,0 +1,24 @@
+#ifndef PARAMETERS_H
+#define PARAMETERS_H
+
+#include "pov.h"
+
+// The parameters get the last sector of the animation flash to themselves,
+// so that writing an animation doesn't wipe them out. Sectors are numbered
+// from the start of the animation flash, like DFU blocks (see dfu.c).
+#define ANIMATION_BLOCKS 23     // Sectors that animations can be written to
+#define PARAMETERS_BLOCK 23     // Sector that the parameters are kept in
+
+// Read the POV parameters from flash
+// @param parameters Set to the saved parameters
+// @return false if none have been saved (or they're from an older layout)
+extern bool loadParameters(POVParameters& parameters);
+
+// Write the POV parameters to flash
+// Note: Interrupts are off while the sector is erased and programmed, which
+// takes several milliseconds. The display keeps running, but nothing else
+// does.
+// @return false if the flash couldn't be written
+extern bool saveParameters(const POVParameters& parameters);
+
+#endif
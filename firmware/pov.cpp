@@ -4,15 +4,9 @@
 #include "matrix.h"
 #include "mma8653.h"
 #include "usb_serial.h"
+#include "parameters.h"
 #include <cstdio>
 
-extern "C" {
-#include "SampleFilter.h"
-};
-
-#define cols 5
-#define rows 2
-
 // accelerometer
 MMA8653 mma8653;
 POV pov;
@@ -20,30 +14,248 @@ POV pov;
 SampleFilter filter;
 
 
-#define playbackScale 120
+// Default parameters (see POVParameters)
+#define DEFAULT_PLAYBACK_SCALE 120
+#define DEFAULT_TICK_SECONDS 17910      // 4.17us
+#define DEFAULT_MIN_PEAK_DROP (2 << MMA8653_FRACTION_BITS)
+
+// Strokes (half a swing) that the swing model will lock on to
+#define MIN_HALF_PERIOD_MS 100
+#define MAX_HALF_PERIOD_MS 1500
+
+// Limits on the parameters, to keep the fixed point sums in range
+#define MAX_PLAYBACK_SCALE 1000
+#define MIN_TICK_SECONDS 429            // 0.1us
+#define MAX_TICK_SECONDS 429497         // 100us
+
+// elapsed() can measure up to half the FTM1 count's range. Steps further
+// apart than 3/4 of that (going by millis()) start the swing over.
+#define MAX_STEP_TICKS 0x7FFF
+
+// The sample filter delays by half its length
+#define FILTER_DELAY_SAMPLES ((SAMPLEFILTER_TAP_NUM - 1)/2)
+
+
+// FTM1_C0SC bits: channel 0 is a software output compare, that interrupts
+// when the next frame is due
+#define FTM_CSC_CHF 0x80        // Channel flag (match happened)
+#define FTM_CSC_CHIE 0x40       // Channel interrupt enable
+#define FTM_CSC_MSA 0x10        // Mode select: output compare (with no pin output)
+
+// A frame due sooner than this (FTM1 ticks) goes up straight away, rather
+// than setting the timer to a count that might have gone by already
+#define MIN_TIMER_WAIT 2
+
+// The timer only counts 16 bits, so a frame due later than this has to wait
+// for a later step to set it (FTM1 ticks)
+#define MAX_TIMER_WAIT 0x7FFF
+
+// No frame (as opposed to -1, blank)
+#define NO_FRAME -2
+
+// A sample further than this from the resting acceleration, on any axis,
+// counts as motion (m/s^2, Q16.16; about 0.1g)
+#define MOTION_THRESHOLD (1 << MMA8653_FRACTION_BITS)
+
+// The resting acceleration follows the samples with a time constant of
+// 2^REST_SHIFT samples (about 0.3s), so a swing stands well clear of it
+#define REST_SHIFT 8
+
+// 1/pi^2 and pi/2, in Q16.16
+#define ONE_OVER_PI_SQUARED 6640
+#define PI_OVER_TWO 102944
+
+// cos(pi*i/256), in Q15
+static const int16_t cosineTable[257] = {
+     32767,  32765,  32757,  32745,  32728,  32705,  32678,  32646,  32609,  32567,  32521,  32469,  32412,  32351,  32285,  32213,
+     32137,  32057,  31971,  31880,  31785,  31685,  31580,  31470,  31356,  31237,  31113,  30985,  30852,  30714,  30571,  30424,
+     30273,  30117,  29956,  29791,  29621,  29447,  29268,  29085,  28898,  28706,  28510,  28310,  28105,  27896,  27683,  27466,
+     27245,  27019,  26790,  26556,  26319,  26077,  25832,  25582,  25329,  25072,  24811,  24547,  24279,  24007,  23731,  23452,
+     23170,  22884,  22594,  22301,  22005,  21705,  21403,  21096,  20787,  20475,  20159,  19841,  19519,  19195,  18868,  18537,
+     18204,  17869,  17530,  17189,  16846,  16499,  16151,  15800,  15446,  15090,  14732,  14372,  14010,  13645,  13279,  12910,
+     12539,  12167,  11793,  11417,  11039,  10659,  10278,   9896,   9512,   9126,   8739,   8351,   7962,   7571,   7179,   6786,
+      6393,   5998,   5602,   5205,   4808,   4410,   4011,   3612,   3212,   2811,   2410,   2009,   1608,   1206,    804,    402,
+         0,   -402,   -804,  -1206,  -1608,  -2009,  -2410,  -2811,  -3212,  -3612,  -4011,  -4410,  -4808,  -5205,  -5602,  -5998,
+     -6393,  -6786,  -7179,  -7571,  -7962,  -8351,  -8739,  -9126,  -9512,  -9896, -10278, -10659, -11039, -11417, -11793, -12167,
+    -12539, -12910, -13279, -13645, -14010, -14372, -14732, -15090, -15446, -15800, -16151, -16499, -16846, -17189, -17530, -17869,
+    -18204, -18537, -18868, -19195, -19519, -19841, -20159, -20475, -20787, -21096, -21403, -21705, -22005, -22301, -22594, -22884,
+    -23170, -23452, -23731, -24007, -24279, -24547, -24811, -25072, -25329, -25582, -25832, -26077, -26319, -26556, -26790, -27019,
+    -27245, -27466, -27683, -27896, -28105, -28310, -28510, -28706, -28898, -29085, -29268, -29447, -29621, -29791, -29956, -30117,
+    -30273, -30424, -30571, -30714, -30852, -30985, -31113, -31237, -31356, -31470, -31580, -31685, -31785, -31880, -31971, -32057,
+    -32137, -32213, -32285, -32351, -32412, -32469, -32521, -32567, -32609, -32646, -32678, -32705, -32728, -32745, -32757, -32765,
+    -32767,
+};
+
+// @param phase 0 to 1 << POV_PHASE_BITS
+// @return cos(pi*phase), in Q15
+static int32_t cosine(uint32_t phase) {
+    uint32_t index = phase >> (POV_PHASE_BITS - 8);
+    if(index >= 256) {
+        return cosineTable[256];
+    }
+
+    int32_t fraction = phase & ((1 << (POV_PHASE_BITS - 8)) - 1);
+    return cosineTable[index]
+           + (((cosineTable[index + 1] - cosineTable[index])*fraction) >> (POV_PHASE_BITS - 8));
+}
+
+// @param value -32767 to 32767 (Q15)
+// @return Phase (0 to 1 << POV_PHASE_BITS) with cos(pi*phase) = value
+static uint32_t arccosine(int32_t value) {
+    // The table only goes down, so find the step that the value is in
+    int low = 0;
+    int high = 256;
+    while(high - low > 1) {
+        int middle = (low + high)/2;
+        if(cosineTable[middle] >= value) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+
+    int32_t step = cosineTable[low] - cosineTable[high];
+    return (low << (POV_PHASE_BITS - 8))
+           + (((cosineTable[low] - value) << (POV_PHASE_BITS - 8)) + step/2)/step;
+}
+
+
+static uint16_t sampleTime;     // FTM1 count when the running read was started
+
+static void sampleReady(int32_t X, int32_t Y, int32_t Z);
 
+// Called from the I2C interrupt, once the orientation has been read
+static void orientationReady(uint8_t orientation)
+{
+    if(orientation != MMA8653_ORIENTATION_UNKNOWN) {
+        pov.orientation = orientation;
+    }
 
-float newAccX, newAccY, newAccZ;
-bool newAcc = false;
+    // A sample came in while the orientation was being read
+    if(digitalReadFast(ACCELEROMETER_INT) == LOW) {
+        sampleTime = FTM1_CNT;
+        mma8653.startRead(sampleReady);
+    }
+}
+
+// Called from the I2C interrupt, once the sample has been read
+static void sampleReady(int32_t X, int32_t Y, int32_t Z)
+{
+    AccelerometerSample sample;
+    sample.time = sampleTime;
+    sample.X = X;
+    sample.Y = Y;
+    sample.Z = Z;
+    pov.samples.put(sample);
+    pov.checkMotion(sample);
+
+    // The orientation interrupt shares the pin, which only interrupts on a
+    // falling edge. If it's still low, the orientation has changed, and has
+    // to be read to let the pin go (or the samples would stop).
+    if(digitalReadFast(ACCELEROMETER_INT) == LOW) {
+        mma8653.startOrientationRead(orientationReady);
+    }
+}
 
 // watermark generates this interrupt
 void readISR()
 {
-    // TODO: This is slow?
-    mma8653.getXYZ(newAccX,newAccY,newAccZ);
-    newAcc = true;
+    if(!mma8653.busy()) {
+        sampleTime = FTM1_CNT;
+    }
+    mma8653.startRead(sampleReady);
 } 
 
+// The next frame is due
+void ftm1_isr(void)
+{
+    if(FTM1_C0SC & FTM_CSC_CHF) {
+        pov.frameDue();
+    }
+}
+
 void POV::setAnimation(Animation *newAnimation) {
+    cancelFrame();
     animation = newAnimation;
+    animation->reset();
+    shownFrame = NO_FRAME;
+
+    // The cache is keyed by frame number
+    clearFrameCache();
+}
+
+void POV::getDefaultParameters(POVParameters& defaults) {
+    defaults.playbackScale = DEFAULT_PLAYBACK_SCALE;
+    for(int i = 0; i < SAMPLEFILTER_TAP_NUM; i++) {
+        defaults.filterTaps[i] = SampleFilter_defaultTaps[i];
+    }
+    defaults.tickSeconds = DEFAULT_TICK_SECONDS;
+    defaults.minPeakDrop = DEFAULT_MIN_PEAK_DROP;
+}
+
+bool POV::setParameters(const POVParameters& newParameters) {
+    if(newParameters.playbackScale == 0 || newParameters.playbackScale > MAX_PLAYBACK_SCALE
+       || newParameters.tickSeconds < MIN_TICK_SECONDS || newParameters.tickSeconds > MAX_TICK_SECONDS
+       || newParameters.minPeakDrop <= 0) {
+        return false;
+    }
+
+    // The filter delay is corrected for as half the filter length, which
+    // only holds for a symmetric filter
+    for(int i = 0; i < SAMPLEFILTER_TAP_NUM/2; i++) {
+        if(newParameters.filterTaps[i] != newParameters.filterTaps[SAMPLEFILTER_TAP_NUM - 1 - i]) {
+            return false;
+        }
+    }
+
+    parameters = newParameters;
+    SampleFilter_setTaps(&filter, parameters.filterTaps);
+
+    uint32_t ticksPerSecond = 0x100000000ULL/parameters.tickSeconds;
+    minHalfPeriod = ticksPerSecond*MIN_HALF_PERIOD_MS/1000;
+    maxHalfPeriod = (uint64_t)ticksPerSecond*MAX_HALF_PERIOD_MS/1000;
+    maxStepMillis = (((uint64_t)MAX_STEP_TICKS*parameters.tickSeconds*1000) >> 32)*3/4;
+
+    // Start the swing over, with the new scale
+    locked = false;
+    accAmplitude = 0;
+    return true;
+}
+
+void POV::setSwingPlaneTracking(bool enabled) {
+    swingPlaneTracking = enabled;
 }
 
 void POV::setup() {
-    velocityX = 0;
-    posX = 0;
+    locked = false;
+    clock = 0;
+    accAmplitude = 0;
+    crossingDue = false;
+
+    swingPlaneTracking = true;
+    swingAxis[0] = 1 << POV_AXIS_BITS;
+    swingAxis[1] = 0;
+    swingAxis[2] = 0;
+    meanSamples = 0;
+
+    samples.clear();
+    orientation = ORIENTATION_UPRIGHT;
+
+    for(int axis = 0; axis < 3; axis++) {
+        restAcceleration[axis] = 0;
+    }
+    lastMotion = millis();
 
     SampleFilter_init(&filter);
 
+    POVParameters saved;
+    if(!loadParameters(saved) || !setParameters(saved)) {
+        POVParameters defaults;
+        getDefaultParameters(defaults);
+        setParameters(defaults);
+    }
+
     // Set up FTM1 to act as a timer for our model
     SIM_SCGC6 |= SIM_SCGC6_FTM1;    // Enable FTM1 clock
     FTM1_MODE = FTM_MODE_WPDIS;    // Disable Write Protect
@@ -55,6 +267,22 @@ void POV::setup() {
     FTM1_MODE |= FTM_MODE_INIT;         // Enable FTM0
     FTM1_SYNC |= 0x80;        // set PWM value update
 
+    lastTime = FTM1_CNT;
+    lastStepMillis = millis();
+
+    // Channel 0 puts frames up on time. It has to beat USB to it, or the
+    // frames jitter by as long as a USB interrupt takes.
+    FTM1_C0SC = FTM_CSC_MSA;
+    dueFrame = NO_FRAME;
+    shownFrame = NO_FRAME;
+    clearJitter();
+    NVIC_SET_PRIORITY(IRQ_FTM1, 64);
+    NVIC_ENABLE_IRQ(IRQ_FTM1);
+
+    // Count CPU cycles, to keep track of how long the model takes
+    ARM_DEMCR |= ARM_DEMCR_TRCENA;
+    ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+
     // Configure the accelerometer interrupt
     pinMode(ACCELEROMETER_INT, INPUT);
 
@@ -67,71 +295,496 @@ void POV::setup() {
     mma8653.setup();
 }
 
-static float accXavgLast;
-static int dirLast;
+// FTM1 ticks from one count to a later one. A count from before the last
+// one (a sample that came in while the last step was running) counts as no
+// time at all.
+static uint16_t elapsed(uint16_t from, uint16_t to) {
+    int16_t ticks = to - from;
+    return (ticks > 0) ? ticks : 0;
+}
 
+// The average acceleration follows 1024 samples (1.3s at 800Hz), so that
+// it's the pull of gravity rather than the swing
+#define MEAN_SHIFT 10
 
-void POV::computeStep() {
+// Learning rate of the swing axis: with a swing of about 10m/s^2, it takes
+// most of a second to settle
+#define AXIS_LEARNING_SHIFT 18
 
-    // TODO: fix the units here...
-    float delta = FTM1_CNT * (0.00000417);
-    FTM1_CNT = 0;   // reset the counter
+int32_t POV::swingAcceleration(const AccelerometerSample& sample) {
+    if(!swingPlaneTracking) {
+        return sample.X;
+    }
 
-    if(newAcc) {
-        accX = newAccX;
-        newAcc = false;
+    const int32_t acc[3] = {sample.X, sample.Y, sample.Z};
 
-        SampleFilter_put(&filter, accX);
-        float accXavg = SampleFilter_get(&filter);
-        if(accXavg - accXavgLast > 0) {
-            dir = 1;
+    // Start the average at the first sample, so gravity doesn't look like a swing
+    if(meanSamples == 0) {
+        for(int axis = 0; axis < 3; axis++) {
+            accMean[axis] = acc[axis];
         }
-        else if(accXavg - accXavgLast < 0) {
-            dir = -1;
+    }
+
+    // Take out the average, which leaves the swing (and its centripetal
+    // acceleration, at twice the rate, which doesn't correlate with it)
+    int32_t variation[3];           // m/s^2, Q8.8
+    int64_t projection = 0;
+    for(int axis = 0; axis < 3; axis++) {
+        accMean[axis] += (acc[axis] - accMean[axis]) >> MEAN_SHIFT;
+        variation[axis] = (acc[axis] - accMean[axis]) >> 8;
+        projection += (int64_t)variation[axis]*swingAxis[axis];
+    }
+    projection >>= POV_AXIS_BITS;
+
+    // Once the average has settled, nudge the axis towards the direction
+    // that the acceleration varies the most in (Oja's rule, which also keeps
+    // it at unit length)
+    if(meanSamples < (1 << MEAN_SHIFT)) {
+        meanSamples++;
+    }
+    else {
+        for(int axis = 0; axis < 3; axis++) {
+            int32_t error = variation[axis] - ((projection*swingAxis[axis] + (1 << (POV_AXIS_BITS - 1))) >> POV_AXIS_BITS);
+            swingAxis[axis] += (projection*error + (1 << (AXIS_LEARNING_SHIFT - 1))) >> AXIS_LEARNING_SHIFT;
         }
-        else {
-            dir=dirLast;
+
+        // Keep it on the same side as X, so that the image isn't mirrored.
+        // Past 90 degrees, the pendant is showing its back anyway.
+        if(swingAxis[0] < 0) {
+            for(int axis = 0; axis < 3; axis++) {
+                swingAxis[axis] = -swingAxis[axis];
+            }
+        }
+    }
+
+    int64_t swing = 0;
+    for(int axis = 0; axis < 3; axis++) {
+        swing += (int64_t)acc[axis]*swingAxis[axis];
+    }
+    return swing >> POV_AXIS_BITS;
+}
+
+void POV::useSample(const AccelerometerSample& sample, uint32_t time) {
+    sampleTimes[sampleIndex] = time;
+    sampleIndex = (sampleIndex + 1) & (POV_DELAY_SAMPLES - 1);
+
+    accX = swingAcceleration(sample);
+
+    SampleFilter_put(&filter, accX);
+    int32_t average = SampleFilter_get(&filter);
+    uint32_t averageTime = sampleTimes[(sampleIndex - 1 - FILTER_DELAY_SAMPLES) & (POV_DELAY_SAMPLES - 1)];
+
+    // In the middle of the stroke, the acceleration crosses half way
+    // between the peaks. Find when, between the two samples.
+    int32_t middle = peakMax/2 + peakMin/2;
+    if(crossingDue && (seekingMax ? (average >= middle) : (average <= middle))) {
+        int64_t before = lastAverage - middle;
+        int64_t after = average - middle;
+        uint32_t time = lastAverageTime;
+        if(before != after) {
+            time += (before*(int32_t)(averageTime - lastAverageTime))/(before - after);
         }
 
-        accXavgLast = accXavg;
+        crossingDue = false;
+        strokeMiddle(time, !seekingMax);
+
+        deviationSum = 0;
+        deviationCount = 0;
     }
 
+    deviationSum += abs(average - middle);
+    deviationCount++;
 
-    if(dir != dirLast) {
-        velocityX = 0;
+    // A maximum is the low end of the swing, where a stroke towards higher
+    // frames starts, and a minimum is the high end
+    int32_t drop = accAmplitude/2;
+    if(drop < parameters.minPeakDrop) {
+        drop = parameters.minPeakDrop;
+    }
 
-        if(dir < 0) {
-            posX = 0;
+    if(seekingMax) {
+        if(average > extreme) {
+            extreme = average;
         }
-        else {
-            posX = animation->frameCount/playbackScale;
+        else if(average < extreme - drop) {
+            peakMax = extreme;
+            seekingMax = false;
+            crossingDue = true;
+            extreme = average;
+        }
+    }
+    else {
+        if(average < extreme) {
+            extreme = average;
         }
+        else if(average > extreme + drop) {
+            peakMin = extreme;
+            seekingMax = true;
+            crossingDue = true;
+            extreme = average;
+        }
+    }
+
+    lastAverage = average;
+    lastAverageTime = averageTime;
+}
+
+void POV::strokeMiddle(uint32_t time, bool nowRising) {
+    uint32_t measured = time - center;
+    bool wasRising = rising;
+
+    center = time;
+    rising = nowRising;
+    // The peaks are noisy, so take the amplitude from the average distance
+    // from the middle instead, which is 2/pi of it for a sine
+    int32_t strokeAmplitude = 0;
+    if(deviationCount > 0) {
+        strokeAmplitude = ((deviationSum/deviationCount)*PI_OVER_TWO) >> 16;
+    }
+
+    if(!locked) {
+        // Start predicting once there's been a stroke of a sensible length
+        if(nowRising == wasRising || measured < minHalfPeriod || measured > maxHalfPeriod) {
+            return;
+        }
+        locked = true;
+        halfPeriod = measured;
+        accAmplitude = strokeAmplitude;
+    }
+    else {
+        // Pull the phase half way to the measurement, and the period a bit
+        // of the way (a second order phase locked loop)
+        int32_t error = measured - halfPeriod;
+        if(nowRising == wasRising || error > (int32_t)halfPeriod/2 || error < -(int32_t)halfPeriod/2) {
+            locked = false;
+            accAmplitude = 0;
+            return;
+        }
+
+        center -= error/2;
+        halfPeriod += error/2;
+        if(halfPeriod < minHalfPeriod) {
+            halfPeriod = minHalfPeriod;
+        }
+        else if(halfPeriod > maxHalfPeriod) {
+            halfPeriod = maxHalfPeriod;
+        }
+
+        accAmplitude += (strokeAmplitude - accAmplitude)/2;
+    }
+
+    phaseRate = 0xFFFFFFFF/halfPeriod;
+
+    // A pendulum's amplitude is its acceleration amplitude over w^2, and w
+    // is pi over the stroke length
+    uint64_t seconds = ((uint64_t)halfPeriod*parameters.tickSeconds) >> 16;   // Q16
+    int64_t meters = ((int64_t)accAmplitude*(int64_t)(seconds*seconds)) >> 32;  // Q16, times pi^2
+    amplitude = (meters*parameters.playbackScale*ONE_OVER_PI_SQUARED) >> 16;
+}
+
+bool POV::strokeAt(uint32_t time, uint32_t& start) {
+    // Strokes carry on from the last measured one, turning round each time.
+    // Before that one started, the swing is still at its end.
+    start = center - halfPeriod/2;
+    int32_t ticks = time - start;
+    if(ticks < 0) {
+        return rising;
+    }
+
+    uint32_t strokes = ((uint64_t)ticks*phaseRate) >> 32;
+    start += strokes*halfPeriod;
+    return rising ^ (strokes & 1);
+}
+
+int POV::frameAt(uint32_t time) {
+    if(!locked) {
+        return -1;
+    }
+
+    uint32_t start;
+    bool strokeRising = strokeAt(time, start);
+
+    int32_t ticks = time - start;
+    if(ticks < 0) {
+        ticks = 0;
+    }
+
+    uint64_t phase = ((uint64_t)ticks*phaseRate) >> (32 - POV_PHASE_BITS);
+    if(phase > (1 << POV_PHASE_BITS)) {
+        phase = 1 << POV_PHASE_BITS;
     }
-    dirLast = dir;
 
-    velocityX += (accX)*delta;
+    // Frames from the center, Q16.16
+    int32_t position = ((int64_t)amplitude*cosine(phase)) >> 15;
+    if(strokeRising) {
+        position = -position;
+    }
+
+    return (position + (animation->frameCount << 15)) >> 16;
+}
+
+bool POV::frameStart(int frame, uint32_t& time) {
+    if(!locked || amplitude <= 0) {
+        return false;
+    }
+
+    uint32_t start;
+    bool strokeRising = strokeAt(clock, start);
 
-    posX += velocityX*delta;
+    // Edge of the frame that the stroke crosses into it at, from the center
+    int32_t edge = ((strokeRising ? frame : frame + 1) << 16) - (animation->frameCount << 15);
+    int64_t value = ((int64_t)(strokeRising ? -edge : edge) << 15)/amplitude;
+    if(value > 32767 || value < -32767) {
+        return false;
+    }
+
+    time = start + (((uint64_t)arccosine(value)*halfPeriod) >> POV_PHASE_BITS);
+    return true;
+}
 
-    int playbackPos = posX*playbackScale;
+int POV::updatePosition() {
+    uint32_t startCycles = ARM_DWT_CYCCNT;
+
+    // After a long stall, the FTM1 count may have wrapped, so there's no
+    // telling how much time went by, or when the waiting samples were
+    // taken. Count it as the longest gap that can be measured, and start
+    // the swing over.
+    uint32_t now = millis();
+    if(now - lastStepMillis > maxStepMillis) {
+        clock += MAX_STEP_TICKS;
+        restartSwing();
+    }
+    lastStepMillis = now;
+
+    // Catch up with each waiting sample, at the time it was taken
+    AccelerometerSample sample;
+    while(samples.get(sample)) {
+        uint16_t ticks = elapsed(lastTime, sample.time);
+        lastTime += ticks;
+        clock += ticks;
+        useSample(sample, clock);
+    }
 
-    if(playbackPos > -1 && playbackPos < animation->frameCount) {
-        uint8_t* frameData = animation->getFrame(playbackPos);
+    uint16_t ticks = elapsed(lastTime, FTM1_CNT);
+    lastTime += ticks;
+    clock += ticks;
 
-        for (uint16_t col = 0; col < cols; col++) {
-            for (uint16_t row = 0; row < rows; row++) {
-                setPixel(col, row,
-                    frameData[(row*cols + col)*3 + 0],
-                    frameData[(row*cols + col)*3 + 1],
-                    frameData[(row*cols + col)*3 + 2]);
+    // Stop predicting if the swing has stopped
+    if(locked && (int32_t)(clock - center) > (int32_t)(2*halfPeriod)) {
+        locked = false;
+        accAmplitude = 0;
+    }
+
+    int playbackPos = frameAt(clock);
+
+    lastStepCycles = ARM_DWT_CYCCNT - startCycles;
+    if(lastStepCycles > maxStepCycles) {
+        maxStepCycles = lastStepCycles;
+    }
+
+    return playbackPos;
+}
+
+void POV::clearJitter() {
+    for(int bin = 0; bin < POV_JITTER_BINS; bin++) {
+        jitterHistogram[bin] = 0;
+    }
+    missedFrames = 0;
+    maxStepCycles = 0;
+}
+
+void POV::recordJitter(uint16_t ticks) {
+    int bin = 0;
+    while(ticks != 0 && bin < POV_JITTER_BINS - 1) {
+        ticks >>= 1;
+        bin++;
+    }
+    jitterHistogram[bin]++;
+}
+
+const Pixel* POV::loadFrame(int frame) {
+    // Upside down, the pendant swings the other way across the image too
+    if(getFlipped() && frame > -1 && frame < animation->frameCount) {
+        frame = animation->frameCount - 1 - frame;
+    }
+
+    return animation->getFramePixels(frame, frameBuffer);
+}
+
+void POV::prepareFrame(int frame) {
+    // Each stroke goes back over the frames of the last one, so the ones
+    // near the turnaround are still cached. The rest are encoded straight
+    // from the animation, without going through the pixels.
+    if(!prepareCached(frame)) {
+        prepareAndCacheFrom(frame, loadFrame(frame));
+    }
+}
+
+void POV::frameDue() {
+    FTM1_C0SC = FTM_CSC_MSA;        // Clear the flag, and stop the timer
+
+    if(dueFrame == NO_FRAME) {
+        return;
+    }
+
+    int16_t late = FTM1_CNT - dueTime;
+    if(present()) {
+        shownFrame = dueFrame;
+        recordJitter(late > 0 ? late : 0);
+    }
+    dueFrame = NO_FRAME;
+}
+
+void POV::cancelFrame() {
+    NVIC_DISABLE_IRQ(IRQ_FTM1);
+    FTM1_C0SC = FTM_CSC_MSA;
+    dueFrame = NO_FRAME;
+    NVIC_ENABLE_IRQ(IRQ_FTM1);
+}
+
+void POV::scheduleFrame(int frame, uint32_t time) {
+    NVIC_DISABLE_IRQ(IRQ_FTM1);
+
+    // It might have gone up while the last step was running
+    if(dueFrame == frame) {
+        uint32_t now = clock + elapsed(lastTime, FTM1_CNT);
+        int32_t wait = time - now;
+
+        dueTime = lastTime + (time - clock);
+        if(wait < MIN_TIMER_WAIT) {
+            frameDue();
+        }
+        else if(wait > MAX_TIMER_WAIT) {
+            FTM1_C0SC = FTM_CSC_MSA;
+        }
+        else {
+            FTM1_C0V = dueTime;
+            FTM1_C0SC = FTM_CSC_MSA | FTM_CSC_CHIE;
+
+            // Another interrupt could have held things up long enough for
+            // the count to go past the compare value without matching it
+            now = clock + elapsed(lastTime, FTM1_CNT);
+            if((int32_t)(time - now) < 0 && !(FTM1_C0SC & FTM_CSC_CHF)) {
+                frameDue();
             }
         }
     }
-    else {
-        for (uint16_t col = 0; col < cols; col++) {
-            for (uint16_t row = 0; row < rows; row++) {
-                setPixel(col, row, 0,0,0);
-            }
+
+    NVIC_ENABLE_IRQ(IRQ_FTM1);
+}
+
+void POV::checkMotion(const AccelerometerSample& sample) {
+    const int32_t acceleration[3] = {sample.X, sample.Y, sample.Z};
+
+    bool moved = false;
+    for(int axis = 0; axis < 3; axis++) {
+        int32_t difference = acceleration[axis] - restAcceleration[axis];
+        restAcceleration[axis] += difference >> REST_SHIFT;
+        moved |= abs(difference) > MOTION_THRESHOLD;
+    }
+
+    if(moved) {
+        lastMotion = millis();
+    }
+}
+
+uint32_t POV::stillTime() const {
+    return millis() - lastMotion;
+}
+
+void POV::sleep() {
+    cancelFrame();
+    shownFrame = NO_FRAME;
+
+    // Keep the sample interrupt from starting a read while the accelerometer
+    // is being set up
+    NVIC_DISABLE_IRQ(IRQ_PORTC);
+    mma8653.stopReads();
+    mma8653.sleep(restAcceleration);
+    NVIC_ENABLE_IRQ(IRQ_PORTC);
+}
+
+void POV::wake() {
+    // The motion event that woke the pendant holds the interrupt pin low
+    // until setup() reads it, and while it's low, the sample and orientation
+    // callbacks keep starting each other's reads. Stop them, rather than
+    // waiting for them to finish.
+    NVIC_DISABLE_IRQ(IRQ_PORTC);
+    mma8653.stopReads();
+    mma8653.setup();
+    NVIC_ENABLE_IRQ(IRQ_PORTC);
+
+    // The clocks stood still while it was asleep, so the swing (and any
+    // samples from waking up) are out of date
+    restartSwing();
+    lastStepMillis = millis();
+    lastMotion = millis();
+}
+
+void POV::restartSwing() {
+    locked = false;
+    accAmplitude = 0;
+    crossingDue = false;
+
+    // The sample interrupt is running, so only the reader's side can be reset
+    samples.discard();
+    lastTime = FTM1_CNT;
+}
+
+void POV::computeStep() {
+    int position = updatePosition();
+
+    int frameCount = animation->frameCount;
+    int frame = (position > -1 && position < frameCount) ? position : -1;
+
+    // Find the next frame along the stroke (leaving the image counts as a
+    // frame, the blank one), and when the stroke gets to it
+    int next = NO_FRAME;
+    uint32_t time;
+    if(locked) {
+        uint32_t start;
+        int nextPosition;
+        if(strokeAt(clock, start)) {
+            nextPosition = (position < 0) ? 0 : position + 1;
+        }
+        else {
+            nextPosition = (position >= frameCount) ? frameCount - 1 : position - 1;
         }
+
+        next = (nextPosition > -1 && nextPosition < frameCount) ? nextPosition : -1;
+        if(next == frame || !frameStart(nextPosition, time)) {
+            next = NO_FRAME;
+        }
+    }
+
+    // The timer can put a frame up a little before the model, with newer
+    // samples, thinks the stroke has got there; leave it up rather than
+    // going back
+    if(next != NO_FRAME && next == shownFrame) {
+        return;
+    }
+
+    // If the next frame is ready already, just follow the model's latest
+    // idea of when it's due
+    if(next != NO_FRAME && next == dueFrame) {
+        scheduleFrame(next, time);
+        return;
+    }
+
+    cancelFrame();
+
+    // The model moved on before the timer could put this frame up (or it just
+    // locked on, or lost the swing)
+    if(frame != shownFrame) {
+        prepareFrame(frame);
+        present();
+        shownFrame = frame;
+        missedFrames++;
+    }
+
+    if(next != NO_FRAME) {
+        prepareFrame(next);
+        dueFrame = next;
+        scheduleFrame(next, time);
     }
 }
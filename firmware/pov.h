@@ -25,23 +25,224 @@
 #define POV_H
 
 #include "animation.h"
+#include "SampleRing.h"
+
+extern "C" {
+#include "SampleFilter.h"
+};
+
+// The model is in fixed point, since there is no FPU: acceleration is in
+// m/s^2, Q16.16 (as read from the accelerometer), and time is in FTM1 ticks.
+
+#define POV_AXIS_BITS 14        // The swing axis is a unit vector, in Q2.14
+#define POV_PHASE_BITS 16       // Stroke phase runs from 0 to 1 << POV_PHASE_BITS
+
+#define POV_DELAY_SAMPLES 8     // Sample times kept, to look back past the filter delay (power of 2)
+
+#define POV_JITTER_BINS 8       // Bins in the frame timing histogram
+
+// Settings for tuning the pendant to a lanyard and a swing, without
+// rebuilding the firmware. They're kept in flash (see parameters.h), and can
+// be changed over serial. The layout is what gets sent over serial, so it
+// can't change without changing the protocol.
+struct POVParameters {
+    uint16_t playbackScale;     // Image width, in frames per meter of swing
+    int16_t filterTaps[SAMPLEFILTER_TAP_NUM];   // Smoothing of the acceleration (Q15, and symmetric, for a fixed delay)
+    uint32_t tickSeconds;       // Length of an FTM1 tick, in seconds (0.32)
+    int32_t minPeakDrop;        // Sensitivity: how far the acceleration has to come back from a peak for it to count (m/s^2, Q16.16)
+};
+
+static_assert(sizeof(POVParameters) == 24, "POVParameters is sent over serial as it is");
 
 class POV {
 private:
-    float accX;           // Current measured X acceleration
-    float accXlast;       // Last measured X acceleration (m/s^2)
-    float velocityX;      // X velocity estimation
-    float posX;           // X position estimation
-    int dir;              // Direction we are travelling in X axis
+    int32_t accX;         // Current acceleration along the swing axis (m/s^2, Q16.16)
+    uint16_t lastTime;    // FTM1 count that the model has been run up to
+    uint32_t clock;       // Time the model has been run up to (FTM1 ticks, without the 16 bit wrap)
+    uint32_t lastStepMillis;    // millis() when the model was last run
+
+    uint32_t sampleTimes[POV_DELAY_SAMPLES];    // Times of the most recent samples
+    uint8_t sampleIndex;                        // Where the next sample time goes
+
+    // Turning points of the filtered acceleration. It peaks at the ends of
+    // the swing, and crosses the middle of its range in the middle of a
+    // stroke, which is where it changes fastest and so gives the best timing.
+    int32_t lastAverage;      // Last filtered acceleration (m/s^2, Q16.16)
+    uint32_t lastAverageTime; // Time it belongs to (FTM1 ticks)
+    bool seekingMax;          // True when looking for a maximum next, false for a minimum
+    bool crossingDue;         // True after a peak, until the middle is crossed
+    int32_t extreme;          // Highest (or lowest) filtered acceleration since the last peak
+    int32_t peakMax;          // Last maximum (m/s^2, Q16.16)
+    int32_t peakMin;          // Last minimum (m/s^2, Q16.16)
+    int64_t deviationSum;     // Total distance of the filtered acceleration from the middle, since the last crossing
+    uint16_t deviationCount;  // Samples in deviationSum
+
+    // Swing model. It's a pendulum, so a stroke from one end of the swing
+    // to the other follows half a cosine. The period and the amplitude are
+    // tracked from stroke to stroke, and the strokes are predicted from
+    // them, rather than integrated from the acceleration.
+    bool locked;              // True while the swing is regular enough to predict
+    bool rising;              // True if the stroke around center runs towards higher frames
+    uint32_t center;          // Estimated time of the middle of the last measured stroke (FTM1 ticks)
+    uint32_t halfPeriod;      // Estimated length of a stroke (FTM1 ticks)
+    uint32_t phaseRate;       // Stroke phase per tick (1/halfPeriod, 0.32)
+    int32_t accAmplitude;     // Estimated acceleration amplitude (m/s^2, Q16.16)
+    int32_t amplitude;        // Estimated swing amplitude (frames, Q16.16)
+
+    bool swingPlaneTracking;    // If true, estimate the swing axis, otherwise assume it's X
+    int32_t swingAxis[3];       // Estimated direction of the swing (Q2.14)
+    int32_t accMean[3];         // Average acceleration on each axis (m/s^2, Q16.16)
+    uint16_t meanSamples;       // Samples that have gone into the average, until it settles
 
     Animation* animation;
+
+    POVParameters parameters;
+    uint32_t minHalfPeriod;     // Shortest stroke the model will lock on to (FTM1 ticks)
+    uint32_t maxHalfPeriod;     // Longest stroke the model will lock on to (FTM1 ticks)
+    uint32_t maxStepMillis;     // Longest gap between steps that the FTM1 count can measure (ms)
+
+    // Frames are put up by the FTM1 channel 0 compare interrupt, at the time
+    // the model predicts, rather than whenever the main loop gets round to
+    // it. The main loop gets the next frame ready ahead of time.
+    volatile int shownFrame;        // Frame last handed to the display (-1 for blank)
+    volatile int dueFrame;          // Frame prepared and waiting for the timer
+    volatile uint16_t dueTime;      // FTM1 count that dueFrame should go up at
+
+    // Stillness, for the power manager. Each sample is compared to a slow
+    // average of the acceleration, which is gravity once the pendant has
+    // been put down.
+    int32_t restAcceleration[3];    // m/s^2, Q16.16
+    volatile uint32_t lastMotion;   // millis() when a sample last moved away from it
+
+    // Frames that have to be decoded go here, rather than in the pixels,
+    // on their way to the encoder
+    Pixel frameBuffer[LED_COUNT];
+
+    // Find an animation frame (or blank, if it's out of range)
+    // @return The frame's pixels, straight from flash if they can be
+    const Pixel* loadFrame(int frame);
+
+    // Get a frame ready for present(), from the frame cache if it's there
+    void prepareFrame(int frame);
+
+    // Prepare a frame, and set the timer to present it
+    // @param time When it should go up (FTM1 ticks, like clock)
+    void scheduleFrame(int frame, uint32_t time);
+
+    // Count a frame that went up late
+    // @param ticks How late it was (FTM1 ticks)
+    void recordJitter(uint16_t ticks);
+
+    // Use a new acceleration sample, and look for the turning points of the swing
+    // @param time When it was taken (FTM1 ticks, like clock)
+    void useSample(const AccelerometerSample& sample, uint32_t time);
+
+    // Update the swing model in the middle of a stroke
+    // @param time When the middle was (FTM1 ticks)
+    // @param nowRising True if the stroke runs towards higher frames
+    void strokeMiddle(uint32_t time, bool nowRising);
+
+    // Find the stroke that a time falls in, going by the model
+    // @param start Set to the time the stroke starts (FTM1 ticks)
+    // @return true if the stroke runs towards higher frames
+    bool strokeAt(uint32_t time, uint32_t& start);
+
+    // Forget the swing and any waiting samples, after the clocks have
+    // stopped, or gone further than the model can follow
+    void restartSwing();
+
+    // Update the swing axis estimate with a new sample
+    // @return Acceleration along the swing axis (m/s^2, Q16.16)
+    int32_t swingAcceleration(const AccelerometerSample& sample);
 public:
+    SampleRing samples;         // Accelerometer samples waiting to be used
+    uint32_t lastStepCycles;    // CPU cycles taken by the last updatePosition()
+    uint32_t maxStepCycles;     // Most CPU cycles taken by updatePosition()
+
+    // How late frames went up, compared to the model's prediction. Bin 0
+    // counts frames that were on time, and bin n those that were 2^(n-1) to
+    // 2^n - 1 FTM1 ticks late; the last bin takes everything later.
+    volatile uint32_t jitterHistogram[POV_JITTER_BINS];
+
+    // Last orientation read from the accelerometer (MMA8653_PORTRAIT_UP, ...,
+    // but not MMA8653_ORIENTATION_UNKNOWN)
+    volatile uint8_t orientation;
+
+    // Frames that were put up from the main loop instead of the timer,
+    // because the model moved on before they could be prepared (or the
+    // swing was just picked up, or lost)
+    volatile uint32_t missedFrames;
+
+    // Start the model over, with the parameters saved in flash (or the
+    // defaults, if there aren't any)
     void setup();
 
     void setAnimation(Animation *newAnimation);
 
-    // Calculate the next step based on accelerometer data
+    // @param defaults Set to the parameters that the firmware was built with
+    static void getDefaultParameters(POVParameters& defaults);
+
+    // Change the parameters (but don't save them)
+    // @return false if they're out of range, and weren't used
+    bool setParameters(const POVParameters& newParameters);
+
+    const POVParameters& getParameters() const { return parameters; }
+
+    // Use all three axes to follow the direction of the swing, so that the
+    // image holds up when the pendant isn't hanging straight. When off, only
+    // X is used.
+    void setSwingPlaneTracking(bool enabled);
+
+    // @return Estimated direction of the swing, as an X, Y, Z unit vector (Q2.14)
+    const int32_t* getSwingAxis() const { return swingAxis; }
+
+    // Run the motion model forward to now, using each waiting accelerometer
+    // sample from the time it was taken
+    // @return Animation frame for the current position (may be out of range)
+    int updatePosition();
+
+    // @return Time the model has been run up to (FTM1 ticks, without the 16 bit wrap)
+    uint32_t getClock() const { return clock; }
+
+    // Predict which frame is showing at a time, on the current stroke. The
+    // image is centered on the swing, at a fixed number of frames per meter
+    // (POVParameters::playbackScale).
+    // @param time FTM1 ticks, like getClock()
+    // @return Animation frame (may be out of range), or -1 if the swing
+    //         isn't regular enough to predict
+    int frameAt(uint32_t time);
+
+    // Predict when a frame starts to show, on the current stroke
+    // @param time Set to the time the frame starts (FTM1 ticks, like getClock())
+    // @return false if the current stroke doesn't reach the frame
+    bool frameStart(int frame, uint32_t& time);
+
+    // Clear the frame timing histogram, the missed frame count, and the
+    // longest step time
+    void clearJitter();
+
+    // Run the model, and make sure the next frame is ready for the timer
     void computeStep();
+
+    // Stop the timer, if a frame is waiting on it. Call this before
+    // something else takes over the display.
+    void cancelFrame();
+
+    // Put the prepared frame up (from the timer interrupt)
+    void frameDue();
+
+    // Look for motion in a new sample (from the sample interrupt)
+    void checkMotion(const AccelerometerSample& sample);
+
+    // @return Milliseconds since the pendant last moved
+    uint32_t stillTime() const;
+
+    // Stop putting frames up, and set the accelerometer to pull its
+    // interrupt pin when the pendant moves
+    void sleep();
+
+    // Start the accelerometer and the swing model over, after sleep()
+    void wake();
 };
 
 extern POV pov;
@@ -0,0 +1,61 @@
+#include "WProgram.h"
+#include "usb_dev.h"
+#include "blinkypendant.h"
+#include "power.h"
+#include "matrix.h"
+#include "pov.h"
+
+#define SMC_PMCTRL_STOPM_STOP 0     // Normal stop mode
+#define SCB_SCR_SLEEPDEEP 0x04      // WFI goes to stop mode, rather than wait
+
+#define PORT_PCR_IRQC_FALLING 10    // Interrupt on a falling edge
+
+#define MCG_S_CLKST_PLL 3
+
+PowerManager power;
+
+bool PowerManager::powerTask() {
+    if(usb_configuration != 0 || pov.stillTime() < SLEEP_DELAY_MS) {
+        return false;
+    }
+
+    sleep();
+    return true;
+}
+
+// The PLL stops in stop mode, and the MCG comes back in PBE mode, running
+// from the crystal. Wait for the PLL to lock again, and switch back to it.
+static void restoreClocks() {
+    while(!(MCG_S & MCG_S_LOCK0)) {}
+    MCG_C1 &= ~MCG_C1_CLKS(3);
+    while((MCG_S & MCG_S_CLKST_MASK) != MCG_S_CLKST(MCG_S_CLKST_PLL)) {}
+}
+
+void PowerManager::sleep() {
+    sleepCount++;
+
+    matrixStop();
+    pov.sleep();
+
+    // The button wakes it too (the port A interrupt just clears the flag)
+    PORTA_PCR3 = (PORTA_PCR3 & ~PORT_PCR_IRQC_MASK) | PORT_PCR_ISF | PORT_PCR_IRQC(PORT_PCR_IRQC_FALLING);
+    NVIC_SET_PRIORITY(IRQ_PORTA, 240);
+    NVIC_ENABLE_IRQ(IRQ_PORTA);
+
+    // Any enabled interrupt wakes it up: the accelerometer's, on port C, or
+    // the button's. The watchdog runs from the bus clock, which stops too.
+    SMC_PMCTRL = SMC_PMCTRL_STOPM(SMC_PMCTRL_STOPM_STOP);
+    (void)SMC_PMCTRL;
+    SCB_SCR |= SCB_SCR_SLEEPDEEP;
+    asm volatile("wfi");
+    SCB_SCR &= ~SCB_SCR_SLEEPDEEP;
+
+    restoreClocks();
+    watchdog_refresh();
+
+    NVIC_DISABLE_IRQ(IRQ_PORTA);
+    PORTA_PCR3 = (PORTA_PCR3 & ~PORT_PCR_IRQC_MASK) | PORT_PCR_ISF;
+
+    pov.wake();
+    matrixSetup();
+}
@@ -0,0 +1,28 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define SLEEP_DELAY_MS 30000    // Time the pendant has to lie still before it goes to sleep
+
+// Puts the pendant to sleep when it's been put down, and wakes it up again
+// when it's picked up (or the button is pressed). While it's asleep, the
+// display is off, the MCU is in stop mode, and the accelerometer is only
+// watching for motion.
+class PowerManager {
+public:
+    uint32_t sleepCount;    // Times the pendant has been to sleep
+
+    // Go to sleep if the pendant has been still for long enough. It doesn't
+    // sleep while it's plugged in to a computer.
+    // @return true if it slept, and has just woken up
+    bool powerTask();
+
+    // Sleep until the pendant moves or the button is pressed, then start the
+    // display and the POV model again
+    void sleep();
+};
+
+extern PowerManager power;
+
+#endif
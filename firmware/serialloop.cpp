@@ -4,6 +4,8 @@
 #include "usb_serial.h"
 #include "animation.h"
 #include "matrix.h"
+#include "pov.h"
+#include "parameters.h"
 #include "dfu.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -61,6 +63,10 @@ void serialLoop() {
     }
 }
 
+bool serialFrameComplete() {
+    return serialMode != SERIAL_MODE_DATA || (pixelIndex == 0 && bufferIndex == 0);
+}
+
 void dataLoop() {
     uint8_t c = usb_serial_getchar();
 
@@ -113,6 +119,11 @@ bool commandStopWrite(uint8_t* buffer);
 bool commandStartRead(uint8_t* buffer);
 bool commandRead(uint8_t* buffer);
 bool commandStopRead(uint8_t* buffer);
+bool commandReadJitter(uint8_t* buffer);
+bool commandReadCacheStats(uint8_t* buffer);
+bool commandReadParameters(uint8_t* buffer);
+bool commandWriteParameters(uint8_t* buffer);
+bool commandSaveParameters(uint8_t* buffer);
 
 struct Command {
     uint8_t name;   // Command identifier
@@ -127,6 +138,11 @@ Command commands[] = {
     {0x04,   1,   commandStartRead},    // Start reading back the animation
     {0x05,   1,   commandRead},         // Read 64 bytes of data
     {0x06,   1,   commandStopRead},     // Stop reading
+    {0x07,   1,   commandReadJitter},   // Read the POV frame timing histogram
+    {0x08,   1,   commandReadCacheStats}, // Read the frame cache hit and miss counts
+    {0x09,   1,   commandReadParameters},   // Read the POV parameters
+    {0x0A,   1 + sizeof(POVParameters), commandWriteParameters}, // Change the POV parameters
+    {0x0B,   1,   commandSaveParameters},   // Save the POV parameters to flash
     {0xFF,   0,   NULL}
 };
 
@@ -240,6 +256,13 @@ bool commandWrite(uint8_t* buffer) {
 
     int blockNum = packetCount / PACKETS_PER_BLOCK;
     int blockLength = DFU_TRANSFER_SIZE;
+
+    // Keep out of the parameters sector
+    if(blockNum >= ANIMATION_BLOCKS) {
+        writing = false;
+        buffer[0] = 0;
+        return false;
+    }
     int packetOffset = ((packetCount % PACKETS_PER_BLOCK) * BYTES_PER_PACKET);
     int packetLength = BYTES_PER_PACKET;
 
@@ -286,3 +309,65 @@ bool commandStopRead(uint8_t* buffer) {
     buffer[0] = 0;
     return true;
 }
+
+// Write a 32 bit count into a reply, least significant byte first
+static uint8_t* putCount(uint8_t* output, uint32_t count) {
+    for(int i = 0; i < 4; i++) {
+        *output++ = count >> (8*i);
+    }
+    return output;
+}
+
+// Reply with how late the POV frames have been going up (see
+// POV::jitterHistogram), the number of missed frames, and the CPU cycles
+// taken by the last and the longest POV model step, and start counting again
+bool commandReadJitter(uint8_t* buffer) {
+    uint8_t* output = buffer + 1;
+    for(int bin = 0; bin < POV_JITTER_BINS; bin++) {
+        output = putCount(output, pov.jitterHistogram[bin]);
+    }
+    output = putCount(output, pov.missedFrames);
+    output = putCount(output, pov.lastStepCycles);
+    output = putCount(output, pov.maxStepCycles);
+    pov.clearJitter();
+
+    buffer[0] = output - (buffer + 1) - 1;
+    return true;
+}
+
+// Reply with the frame cache hits, then misses, and start counting again
+bool commandReadCacheStats(uint8_t* buffer) {
+    FrameCacheStats stats = getFrameCacheStats();
+    clearFrameCacheStats();
+
+    uint8_t* output = buffer + 1;
+    output = putCount(output, stats.hits);
+    output = putCount(output, stats.misses);
+
+    buffer[0] = output - (buffer + 1) - 1;
+    return true;
+}
+
+// Reply with the POV parameters, laid out as in POVParameters
+bool commandReadParameters(uint8_t* buffer) {
+    const POVParameters& parameters = pov.getParameters();
+    memcpy(buffer + 1, &parameters, sizeof(parameters));
+
+    buffer[0] = sizeof(parameters) - 1;
+    return true;
+}
+
+// Start using new POV parameters, laid out as in POVParameters. They're lost
+// at the next reset, unless they're saved.
+bool commandWriteParameters(uint8_t* buffer) {
+    POVParameters parameters;
+    memcpy(&parameters, buffer, sizeof(parameters));
+
+    buffer[0] = 0;
+    return pov.setParameters(parameters);
+}
+
+bool commandSaveParameters(uint8_t* buffer) {
+    buffer[0] = 0;
+    return saveParameters(pov.getParameters());
+}
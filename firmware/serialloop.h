@@ -30,4 +30,8 @@
 extern void serialReset();
 extern void serialLoop();
 
+// @return false while a streamed frame has only partly arrived, so the pixels
+// are a mix of it and the last one
+extern bool serialFrameComplete();
+
 #endif
@@ -0,0 +1,630 @@
+"""BlinkyPendant animation encoder.
+
+  Turns an image into animation frame data, in each of the encodings that
+  the firmware can decode (see firmware/animation.h), and picks the
+  smallest. Each column of a PNG (or single frame GIF) is a POV frame, and
+  each row an LED. Each frame of an animated GIF is a timed frame, the size
+  of the display.
+"""
+
+from __future__ import print_function
+
+import os
+import re
+import struct
+import sys
+import zlib
+
+ENCODING_RGB24 = 0
+ENCODING_RGB565 = 1
+ENCODING_RGB565_RLE = 2
+ENCODING_INDEXED_4 = 3
+ENCODING_INDEXED_8 = 4
+ENCODING_XOR_DELTA = 5
+
+ENCODING_NAMES = {
+    ENCODING_RGB24: "ENCODING_RGB24",
+    ENCODING_RGB565: "ENCODING_RGB565",
+    ENCODING_RGB565_RLE: "ENCODING_RGB565_RLE",
+    ENCODING_INDEXED_4: "ENCODING_INDEXED_4",
+    ENCODING_INDEXED_8: "ENCODING_INDEXED_8",
+    ENCODING_XOR_DELTA: "ENCODING_XOR_DELTA",
+}
+
+# Frames between keyframes, in the variable length encodings. Seeking to a
+# frame decodes at most this many less one, on top of the keyframe.
+KEYFRAME_INTERVAL = 8
+
+# Animation container (see firmware/animations.h)
+CONTAINER_MAGIC = b"BP"
+CONTAINER_VERSION = 2
+CONTAINER_SIZE = 23*1024
+
+DISPLAYMODE_POV = 10
+DISPLAYMODE_TIMED = 11
+
+# The pendant's LED layout
+FRAME_WIDTH = 5
+FRAME_HEIGHT = 2
+
+# RGB565 drops the low bits of each color, so it's only picked when that
+# doesn't change anything, unless lossy encodings are allowed
+LOSSY_ENCODINGS = (ENCODING_RGB565, ENCODING_RGB565_RLE)
+
+
+def readPng(path):
+    """Read an 8 bit per channel, non-interlaced PNG (RGB, RGBA, grey or
+    palette).
+
+    Returns (width, height, rows), where each row is a list of (r, g, b).
+    """
+    data = open(path, "rb").read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise ValueError("%s isn't a PNG" % path)
+
+    chunks = []
+    palette = None
+    position = 8
+    while position < len(data):
+        length, kind = struct.unpack(">I4s", data[position:position + 8])
+        body = data[position + 8:position + 8 + length]
+        position += 12 + length
+
+        if kind == b"IHDR":
+            width, height, depth, colorType, _, _, interlace = struct.unpack(">IIBBBBB", body)
+        elif kind == b"PLTE":
+            palette = [tuple(bytearray(body[i:i + 3])) for i in range(0, len(body), 3)]
+        elif kind == b"IDAT":
+            chunks.append(body)
+        elif kind == b"IEND":
+            break
+
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}.get(colorType)
+    if depth != 8 or interlace != 0 or channels is None:
+        raise ValueError("%s: only 8 bit, non-interlaced PNGs are supported" % path)
+
+    raw = bytearray(zlib.decompress(b"".join(chunks)))
+    stride = width*channels
+    rows = []
+    previous = bytearray(stride)
+    for y in range(height):
+        start = y*(stride + 1)
+        kind = raw[start]
+        line = raw[start + 1:start + 1 + stride]
+        for x in range(stride):
+            left = line[x - channels] if x >= channels else 0
+            up = previous[x]
+            upLeft = previous[x - channels] if x >= channels else 0
+            if kind == 1:
+                line[x] = (line[x] + left) & 0xFF
+            elif kind == 2:
+                line[x] = (line[x] + up) & 0xFF
+            elif kind == 3:
+                line[x] = (line[x] + (left + up)//2) & 0xFF
+            elif kind == 4:
+                p = left + up - upLeft
+                pa, pb, pc = abs(p - left), abs(p - up), abs(p - upLeft)
+                predictor = left if (pa <= pb and pa <= pc) else (up if pb <= pc else upLeft)
+                line[x] = (line[x] + predictor) & 0xFF
+        previous = line
+
+        row = []
+        for x in range(width):
+            pixel = line[x*channels:(x + 1)*channels]
+            if colorType == 3:
+                row.append(palette[pixel[0]])
+            elif channels <= 2:
+                row.append((pixel[0], pixel[0], pixel[0]))
+            else:
+                row.append((pixel[0], pixel[1], pixel[2]))
+        rows.append(row)
+
+    return width, height, rows
+
+
+def lzwDecode(data, minimumCodeSize):
+    """Decompress GIF image data."""
+    clear = 1 << minimumCodeSize
+    end = clear + 1
+
+    codeSize = minimumCodeSize + 1
+    table = [bytearray([i]) for i in range(clear)] + [None, None]
+    output = bytearray()
+    previous = None
+
+    bits = 0
+    bitCount = 0
+    for byte in bytearray(data):
+        bits |= byte << bitCount
+        bitCount += 8
+        while bitCount >= codeSize:
+            code = bits & ((1 << codeSize) - 1)
+            bits >>= codeSize
+            bitCount -= codeSize
+
+            if code == clear:
+                table = table[:end + 1]
+                codeSize = minimumCodeSize + 1
+                previous = None
+                continue
+            if code == end:
+                return output
+
+            if previous is None:
+                entry = table[code]
+            elif code < len(table):
+                entry = table[code]
+                table.append(previous + entry[:1])
+            elif code == len(table):
+                entry = previous + previous[:1]
+                table.append(entry)
+            else:
+                raise ValueError("bad LZW code")
+
+            output.extend(entry)
+            previous = entry
+            if len(table) == (1 << codeSize) and codeSize < 12:
+                codeSize += 1
+
+    return output
+
+
+def readGif(path):
+    """Read a GIF, with every frame drawn over the ones before it as a
+    browser would (transparent pixels and the disposal methods are honored;
+    the background is black).
+
+    Returns (width, height, frames, delays), where each frame is a list of
+    rows of (r, g, b), and each delay is in ms.
+    """
+    data = bytearray(open(path, "rb").read())
+    if data[:6] not in (b"GIF87a", b"GIF89a"):
+        raise ValueError("%s isn't a GIF" % path)
+
+    width, height, flags = struct.unpack("<HHB", bytes(data[6:11]))
+    position = 13
+
+    def colorTable(flags):
+        colors = []
+        if flags & 0x80:
+            count = 2 << (flags & 0x07)
+            colors = [tuple(data[position + i*3:position + i*3 + 3]) for i in range(count)]
+        return colors
+
+    def subBlocks(position):
+        blocks = bytearray()
+        while data[position] != 0:
+            blocks.extend(data[position + 1:position + 1 + data[position]])
+            position += 1 + data[position]
+        return blocks, position + 1
+
+    globalColors = colorTable(flags)
+    position += 3*len(globalColors)
+
+    canvas = [[(0, 0, 0)]*width for y in range(height)]
+    frames = []
+    delays = []
+    delay = 0
+    transparent = None
+    disposal = 0
+
+    while position < len(data):
+        block = data[position]
+        if block == 0x3B:
+            break
+
+        elif block == 0x21:
+            label = data[position + 1]
+            body, position = subBlocks(position + 2)
+            if label == 0xF9 and len(body) >= 4:
+                disposal = (body[0] >> 2) & 0x07
+                delay = (body[1] | (body[2] << 8))*10
+                transparent = body[3] if body[0] & 0x01 else None
+
+        elif block == 0x2C:
+            left, top, frameWidth, frameHeight, flags = struct.unpack("<HHHHB", bytes(data[position + 1:position + 10]))
+            position += 10
+            colors = colorTable(flags) or globalColors
+            position += 3*len(colorTable(flags))
+
+            minimumCodeSize = data[position]
+            body, position = subBlocks(position + 1)
+            indexes = lzwDecode(body, minimumCodeSize)
+
+            rows = list(range(frameHeight))
+            if flags & 0x40:
+                rows = (list(range(0, frameHeight, 8)) + list(range(4, frameHeight, 8))
+                        + list(range(2, frameHeight, 4)) + list(range(1, frameHeight, 2)))
+
+            previous = [list(row) for row in canvas]
+            for i, y in enumerate(rows):
+                for x in range(frameWidth):
+                    index = indexes[i*frameWidth + x]
+                    if index != transparent and 0 <= top + y < height and 0 <= left + x < width:
+                        canvas[top + y][left + x] = colors[index]
+
+            frames.append([list(row) for row in canvas])
+            delays.append(delay)
+
+            if disposal == 2:
+                for y in range(top, min(top + frameHeight, height)):
+                    for x in range(left, min(left + frameWidth, width)):
+                        canvas[y][x] = (0, 0, 0)
+            elif disposal == 3:
+                canvas = previous
+            delay = 0
+            transparent = None
+            disposal = 0
+
+        else:
+            raise ValueError("%s: unexpected block 0x%02x" % (path, block))
+
+    return width, height, frames, delays
+
+
+def readAnimation(path, frameDelay):
+    """Read the frames of an animation from an image.
+
+    Returns (frames, frameDelay, displayMode). Animated GIFs keep their own
+    delay (the first frame's), if they have one.
+    """
+    if path.lower().endswith(".gif"):
+        width, height, images, delays = readGif(path)
+        if len(images) > 1:
+            if (width, height) != (FRAME_WIDTH, FRAME_HEIGHT):
+                raise ValueError("%s: animated GIFs have to be %ix%i" % (path, FRAME_WIDTH, FRAME_HEIGHT))
+            frames = [[color for row in image for color in row] for image in images]
+            return frames, delays[0] or frameDelay, DISPLAYMODE_TIMED
+        rows = images[0]
+    else:
+        width, height, rows = readPng(path)
+
+    return imageFrames(rows), frameDelay, DISPLAYMODE_POV
+
+
+def imageFrames(rows):
+    """Frames from image rows: a frame per column, an LED per row."""
+    return [[row[x] for row in rows] for x in range(len(rows[0]))]
+
+
+def toRgb565(color):
+    r, g, b = color
+    return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3)
+
+
+def fromRgb565(value):
+    """The color that the firmware decodes an RGB565 value to."""
+    r, g, b = value >> 11, (value >> 5) & 0x3F, value & 0x1F
+    return ((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2))
+
+
+def encodeRgb24(frames):
+    data = bytearray()
+    for frame in frames:
+        for color in frame:
+            data.extend(color)
+    return data
+
+
+def encodeRgb565(frames):
+    data = bytearray()
+    for frame in frames:
+        for color in frame:
+            data.extend(struct.pack("<H", toRgb565(color)))
+    return data
+
+
+def keyframeIndex(frames, interval):
+    """Prefix the encoded frames with a keyframe index.
+
+    frames is a list of the encoded data for each frame.
+    """
+    index = bytearray([interval])
+    data = bytearray()
+    for i, frame in enumerate(frames):
+        if interval and i % interval == 0:
+            if len(data) > 0xFFFF:
+                raise ValueError("frame data too long for the keyframe index")
+            index.extend(struct.pack("<H", len(data)))
+        data.extend(frame)
+    return index + data
+
+
+def encodeRgb565Rle(frames, interval=KEYFRAME_INTERVAL):
+    encoded = []
+    for frame in frames:
+        data = bytearray()
+        values = [toRgb565(color) for color in frame]
+        i = 0
+        while i < len(values):
+            run = 1
+            while i + run < len(values) and values[i + run] == values[i] and run < 255:
+                run += 1
+            data.append(run)
+            data.extend(struct.pack("<H", values[i]))
+            i += run
+        encoded.append(data)
+    return keyframeIndex(encoded, interval)
+
+
+def palette(frames):
+    """Colors used in the frames, most used first."""
+    counts = {}
+    for frame in frames:
+        for color in frame:
+            counts[color] = counts.get(color, 0) + 1
+    return sorted(counts, key=lambda color: (-counts[color], color))
+
+
+def encodeIndexed(frames, bits):
+    """Palette encoding, or None if there are too many colors."""
+    colors = palette(frames)
+    if len(colors) > (1 << bits):
+        return None
+
+    index = dict((color, i) for i, color in enumerate(colors))
+    data = bytearray([len(colors) - 1])
+    for color in colors:
+        data.extend(color)
+
+    for frame in frames:
+        indexes = [index[color] for color in frame]
+        if bits == 4:
+            if len(indexes) % 2:
+                indexes.append(0)
+            for i in range(0, len(indexes), 2):
+                data.append(indexes[i] | (indexes[i + 1] << 4))
+        else:
+            data.extend(indexes)
+    return data
+
+
+def encodeXorDelta(frames, interval=KEYFRAME_INTERVAL):
+    """XOR deltas, with each keyframe the difference from black."""
+    encoded = []
+    black = [(0, 0, 0)]*len(frames[0])
+    last = black
+    for number, frame in enumerate(frames):
+        if number == 0 or (interval and number % interval == 0):
+            last = black
+        data = bytearray()
+        changed = bytearray((len(frame) + 7)//8)
+        changes = bytearray()
+        for i, (color, old) in enumerate(zip(frame, last)):
+            if color != old:
+                changed[i//8] |= 1 << (i % 8)
+                changes.extend(a ^ b for a, b in zip(color, old))
+        data.extend(changed)
+        data.extend(changes)
+        encoded.append(data)
+        last = frame
+    return keyframeIndex(encoded, interval)
+
+
+def encodeAll(frames, allowLossy=False, interval=KEYFRAME_INTERVAL):
+    """Encode the frames every way that fits.
+
+    Returns a dict of encoding: data. The lossy encodings are left out,
+    unless they happen to be exact, or allowLossy is set.
+    """
+    encodings = {
+        ENCODING_RGB24: encodeRgb24(frames),
+        ENCODING_XOR_DELTA: encodeXorDelta(frames, interval),
+    }
+
+    exact565 = all(fromRgb565(toRgb565(color)) == color for frame in frames for color in frame)
+    if allowLossy or exact565:
+        encodings[ENCODING_RGB565] = encodeRgb565(frames)
+        encodings[ENCODING_RGB565_RLE] = encodeRgb565Rle(frames, interval)
+
+    for encoding, bits in ((ENCODING_INDEXED_4, 4), (ENCODING_INDEXED_8, 8)):
+        data = encodeIndexed(frames, bits)
+        if data is not None:
+            encodings[encoding] = data
+
+    return encodings
+
+
+def encode(frames, allowLossy=False, interval=KEYFRAME_INTERVAL):
+    """Pick the smallest encoding for the frames.
+
+    Returns (encoding, data).
+    """
+    encodings = encodeAll(frames, allowLossy, interval)
+    encoding = min(encodings, key=lambda e: (len(encodings[e]), e))
+    return encoding, encodings[encoding]
+
+
+def container(patterns):
+    """Build an animation container, ready to write to the animation flash.
+
+    patterns is a list of (encoding, data, frameCount, frameDelay,
+    displayMode) for each pattern. Frame data is 4 byte aligned.
+    """
+    header = CONTAINER_MAGIC + struct.pack("<BB", CONTAINER_VERSION, len(patterns))
+    offset = 8 + 20*len(patterns)
+
+    table = bytearray()
+    data = bytearray()
+    for encoding, frames, frameCount, frameDelay, displayMode in patterns:
+        padding = -(offset + len(data)) % 4
+        data.extend(b"\xff"*padding)
+        table.extend(struct.pack("<IIIHHBBBB", offset + len(data), len(frames),
+                                 zlib.crc32(bytes(frames)) & 0xFFFFFFFF,
+                                 frameCount, frameDelay, encoding, displayMode,
+                                 FRAME_WIDTH, FRAME_HEIGHT))
+        data.extend(frames)
+
+    crc = zlib.crc32(bytes(table), zlib.crc32(header)) & 0xFFFFFFFF
+    image = bytearray(header) + struct.pack("<I", crc) + table + data
+    if len(image) > CONTAINER_SIZE:
+        raise ValueError("animations are %i bytes, only %i fit" % (len(image), CONTAINER_SIZE))
+    return image
+
+
+def cArray(name, data, indent="    ", declaration="const uint8_t %s[]"):
+    """C source for a byte array."""
+    lines = [(declaration % name) + " = {"]
+    for i in range(0, len(data), 16):
+        lines.append(indent + "".join("%3i, " % b for b in data[i:i + 16]).rstrip())
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def cHeader(name, frames, frameDelay, encodings):
+    """C header with an Animation for each of the given encodings."""
+    out = "// This file was automatically generated using 'animationencoder.py'\n\n"
+    for encoding in sorted(encodings):
+        suffix = "" if len(encodings) == 1 else "_" + ENCODING_NAMES[encoding][len("ENCODING_"):].lower()
+        data = encodings[encoding]
+        out += "// %s: %i bytes\n" % (ENCODING_NAMES[encoding], len(data))
+        out += cArray("%s%sData" % (name, suffix), data)
+        out += "\nAnimation %s%sAnimation(%i, %s%sData, %s, %i, %i);\n\n" % (
+            name, suffix, len(frames), name, suffix, ENCODING_NAMES[encoding], len(frames[0]), frameDelay)
+    return out
+
+
+def identifier(path):
+    """C name for an image: its file name, in camel case."""
+    words = [word for word in re.split("[^0-9A-Za-z]+", os.path.splitext(os.path.basename(path))[0]) if word]
+    name = "".join([words[0]] + [word[:1].upper() + word[1:] for word in words[1:]])
+    if not name or name[0].isdigit():
+        name = "animation" + name
+    return name
+
+
+def frameLayout(encoding, data, frameCount):
+    """Where frame 0 starts in the data, the keyframe interval, and where the
+    keyframe index starts (or None), as Animation::init() works them out."""
+    if encoding in (ENCODING_INDEXED_4, ENCODING_INDEXED_8):
+        return 1 + (data[0] + 1)*3, 0, None
+    if encoding in (ENCODING_RGB565_RLE, ENCODING_XOR_DELTA):
+        interval = data[0]
+        if interval == 0:
+            return 1, 0, None
+        return 1 + (frameCount + interval - 1)//interval*2, interval, 1
+    return 0, 0, None
+
+
+def builtinHeader(animations, interval=KEYFRAME_INTERVAL):
+    """C++ header with animations to build in to the firmware.
+
+    animations is a list of (path, frames, frameDelay, displayMode). Each gets
+    its smallest lossless encoding. The data is word aligned, in flash, and
+    the Animations are set up at compile time, with their layout (and
+    keyframe index) already worked out.
+    """
+    out = "// This file was automatically generated using 'animationencoder.py'. Don't\n"
+    out += "// edit it: change the images, or ANIMATION_SOURCES in the Makefile.\n\n"
+    out += "#ifndef ANIMATIONS_BUILTIN_H\n#define ANIMATIONS_BUILTIN_H\n\n"
+    out += "#include \"animations.h\"\n\n"
+
+    names = []
+    for path, frames, frameDelay, displayMode in animations:
+        name = identifier(path)
+        if name in [n for n, mode in names]:
+            raise ValueError("%s: there's already an animation called %s" % (path, name))
+        if len(frames[0]) != FRAME_WIDTH*FRAME_HEIGHT:
+            raise ValueError("%s: frames have to be %i LEDs" % (path, FRAME_WIDTH*FRAME_HEIGHT))
+        names.append((name, displayMode))
+
+        encoding, data = encode(frames, False, interval)
+        first, keyframeInterval, index = frameLayout(encoding, data, len(frames))
+
+        out += "// %s: %i frames, %s, %i bytes\n" % (
+            os.path.basename(path), len(frames), ENCODING_NAMES[encoding], len(data))
+        out += cArray("%sData" % name, data,
+                      declaration="constexpr uint8_t %s[] __attribute__ ((aligned(4)))")
+        out += "\nAnimation %sAnimation(%i, %sData, %s, %i, %i,\n" % (
+            name, len(frames), name, ENCODING_NAMES[encoding], len(frames[0]), frameDelay)
+        out += "    %sData + %i, %i, %s);\n\n" % (
+            name, first, keyframeInterval, "NULL" if index is None else "%sData + %i" % (name, index))
+
+    out += "BuiltinAnimation builtinAnimations[] = {\n"
+    for name, displayMode in names:
+        out += "    {&%sAnimation, %s},\n" % (
+            name, "DISPLAYMODE_POV" if displayMode == DISPLAYMODE_POV else "DISPLAYMODE_TIMED")
+    out += "};\n\n"
+    out += "#define BUILTIN_ANIMATION_COUNT %i\n\n#endif\n" % len(names)
+    return out
+
+
+if __name__ == "__main__":
+    import optparse
+
+    parser = optparse.OptionParser(usage="%prog [options] image.png [image.png...]")
+    parser.add_option("-n", "--name", dest="name", default="animation",
+                      help="C name for the animation")
+    parser.add_option("-d", "--delay", dest="delay", type="int", default=50,
+                      help="delay between frames, in ms")
+    parser.add_option("-o", "--output", dest="output", default=None,
+                      help="C header to write (default: stdout)")
+    parser.add_option("-a", "--all", dest="all", action="store_true", default=False,
+                      help="write every encoding, instead of the smallest")
+    parser.add_option("-k", "--keyframe-interval", dest="interval", type="int",
+                      default=KEYFRAME_INTERVAL,
+                      help="frames between keyframes (0 for no index)")
+    parser.add_option("-c", "--container", dest="container", action="store_true", default=False,
+                      help="write an animation container with a pattern for each image "
+                           "(raw, if the output ends in .bin)")
+    parser.add_option("-m", "--mode", dest="mode", default=None, choices=["pov", "timed"],
+                      help="display mode for the container's patterns (pov or timed; by "
+                           "default, timed for animated GIFs and POV for the rest)")
+    parser.add_option("-b", "--builtin", dest="builtin", action="store_true", default=False,
+                      help="write a header of animations to build in to the firmware")
+    parser.add_option("-l", "--lossy", dest="lossy", action="store_true", default=False,
+                      help="allow encodings that lose color resolution")
+    (options, args) = parser.parse_args()
+
+    if len(args) != 1 and not ((options.container or options.builtin) and len(args) > 0):
+        parser.error("expected one image")
+    if not 0 <= options.interval <= 255:
+        parser.error("the keyframe interval has to fit in a byte")
+
+    if options.builtin:
+        animations = [(path,) + readAnimation(path, options.delay) for path in args]
+        header = builtinHeader(animations, options.interval)
+        if options.output:
+            open(options.output, "w").write(header)
+        else:
+            sys.stdout.write(header)
+        sys.exit(0)
+
+    if options.container:
+        patterns = []
+        for path in args:
+            frames, frameDelay, mode = readAnimation(path, options.delay)
+            if options.mode:
+                mode = DISPLAYMODE_POV if options.mode == "pov" else DISPLAYMODE_TIMED
+            encoding, data = encode(frames, options.lossy, options.interval)
+            print("%-30s %-20s %6i bytes" % (path, ENCODING_NAMES[encoding], len(data)), file=sys.stderr)
+            patterns.append((encoding, data, len(frames), frameDelay, mode))
+        image = container(patterns)
+
+        if options.output and options.output.endswith(".bin"):
+            open(options.output, "wb").write(image)
+        else:
+            header = "// This file was automatically generated using 'animationencoder.py'\n\n"
+            header += cArray("%sContainer" % options.name, image)
+            if options.output:
+                open(options.output, "w").write(header)
+            else:
+                sys.stdout.write(header)
+        sys.exit(0)
+
+    frames, frameDelay, mode = readAnimation(args[0], options.delay)
+
+    if options.all:
+        encodings = encodeAll(frames, options.lossy, options.interval)
+    else:
+        encoding, data = encode(frames, options.lossy, options.interval)
+        encodings = {encoding: data}
+
+    for encoding in sorted(encodings):
+        print("%-20s %6i bytes" % (ENCODING_NAMES[encoding], len(encodings[encoding])), file=sys.stderr)
+
+    header = cHeader(options.name, frames, frameDelay, encodings)
+    if options.output:
+        open(options.output, "w").write(header)
+    else:
+        sys.stdout.write(header)